@@ -0,0 +1,95 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace nn {
+
+// Per-layer activation. THRESHOLD is the original behaviour: softsign, then
+// 1 above the node's threshold and 0 otherwise. The others are continuous
+// and ignore the threshold genes.
+enum activation_type {
+    ACTIVATION_THRESHOLD = 0,
+    ACTIVATION_SOFTSIGN,
+    ACTIVATION_RELU,
+    ACTIVATION_TANH,        // rational approximation, max error ~0.024
+    ACTIVATION_IDENTITY,
+    ACTIVATION_COUNT
+};
+
+// x / (1 + |x|), used for node values and to squash connection weights.
+inline double softsign(double x) {
+    return x / (1 + std::abs(x));
+}
+
+// tanh(x) ~ x(27 + x^2) / (27 + 9x^2), clamped to [-1, 1] where it overshoots.
+inline double tanh_approx(double x) {
+    if (x > 3) return 1;
+    if (x < -3) return -1;
+    double x2 = x * x;
+    return x * (27 + x2) / (27 + 9 * x2);
+}
+
+inline double activate(activation_type type, double x, double threshold) {
+    switch (type) {
+    case ACTIVATION_THRESHOLD:  return softsign(x) > threshold ? 1 : 0;
+    case ACTIVATION_SOFTSIGN:   return softsign(x);
+    case ACTIVATION_RELU:       return x > 0 ? x : 0;
+    case ACTIVATION_TANH:       return tanh_approx(x);
+    default:                    return x;
+    }
+}
+
+// Apply an activation in place to a whole layer of n values.
+inline void activate_layer(activation_type type, double *values, const double *thresholds, uint32_t n) {
+    uint32_t i = 0;
+#ifdef __SSE2__
+    const __m128d sign = _mm_set1_pd(-0.0);
+    const __m128d one = _mm_set1_pd(1.0);
+    switch (type) {
+    case ACTIVATION_THRESHOLD:
+        for (; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(values + i);
+            __m128d s = _mm_div_pd(x, _mm_add_pd(one, _mm_andnot_pd(sign, x)));
+            __m128d fired = _mm_cmpgt_pd(s, _mm_loadu_pd(thresholds + i));
+            _mm_storeu_pd(values + i, _mm_and_pd(fired, one));
+        }
+        break;
+    case ACTIVATION_SOFTSIGN:
+        for (; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(values + i);
+            _mm_storeu_pd(values + i, _mm_div_pd(x, _mm_add_pd(one, _mm_andnot_pd(sign, x))));
+        }
+        break;
+    case ACTIVATION_RELU:
+        for (; i + 2 <= n; i += 2) {
+            _mm_storeu_pd(values + i, _mm_max_pd(_mm_loadu_pd(values + i), _mm_setzero_pd()));
+        }
+        break;
+    case ACTIVATION_TANH: {
+        const __m128d c27 = _mm_set1_pd(27.0);
+        const __m128d c9 = _mm_set1_pd(9.0);
+        const __m128d three = _mm_set1_pd(3.0);
+        for (; i + 2 <= n; i += 2) {
+            __m128d x = _mm_loadu_pd(values + i);
+            x = _mm_max_pd(_mm_min_pd(x, three), _mm_sub_pd(_mm_setzero_pd(), three));
+            __m128d x2 = _mm_mul_pd(x, x);
+            __m128d num = _mm_mul_pd(x, _mm_add_pd(c27, x2));
+            __m128d den = _mm_add_pd(c27, _mm_mul_pd(c9, x2));
+            _mm_storeu_pd(values + i, _mm_div_pd(num, den));
+        }
+        break;
+    }
+    default:
+        return;
+    }
+#endif
+    for (; i < n; i++) {
+        values[i] = activate(type, values[i], thresholds[i]);
+    }
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "neural_pool.h"
+
+namespace nn {
+
+// When an anytime_search gives up. The defaults never do.
+struct search_budget {
+    std::chrono::steady_clock::time_point   _deadline = std::chrono::steady_clock::time_point::max();
+    uint64_t                                _max_evaluations = UINT64_MAX;
+    double                                  _target = std::numeric_limits<double>::infinity();
+
+    // Convenience for a deadline relative to now.
+    static search_budget seconds(double s) {
+        search_budget b;
+        b._deadline = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(s));
+        return b;
+    }
+};
+
+// Evolve the pool generation by generation, scoring every candidate on the
+// pool's workers, until the target score is reached, the budget is spent or
+// stop() is called. The best genome seen so far is kept and can be read from
+// any thread while the search runs.
+//
+// Budgets are checked between generations, and a generation only starts if
+// it fits: its candidates must fit in the remaining evaluations, and the
+// previous generation's duration must fit before the deadline. A run thus
+// ends by its deadline unless generations suddenly get slower.
+class anytime_search {
+
+public:
+    anytime_search(neural_pool &pool,
+                   const std::vector<test_case> &cases,
+                   const fitness_function &fitness)
+        : _pool(pool),
+          _cases(cases),
+          _fitness(fitness),
+          _best(_gen) {}
+
+    // Returns the best score found, -infinity if nothing was evaluated.
+    double run(const search_budget &budget = search_budget()) {
+        _running = true;
+        std::chrono::steady_clock::duration last_generation(0);
+        std::vector<double> scores;
+        while (!_stop) {
+            uint32_t size = _pool.get_structures().size();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (budget._max_evaluations - _evaluations < size) break;
+            if (budget._deadline - start < last_generation) break;
+
+            _pool.evaluate_pool(_cases, _fitness, scores);
+            _evaluations += size;
+            uint32_t best = arg_max(scores);
+            if (!scores.empty()) offer(_pool.get_structures()[best]->get_config(), scores[best]);
+            _generations++;
+            if (best_score() >= budget._target) break;
+
+            _pool.mutate_pool();
+            last_generation = std::chrono::steady_clock::now() - start;
+        }
+        _stop = false;
+        _running = false;
+        return best_score();
+    }
+
+    // run() on neural_pool::compute_pool_pipelined(), which builds the next
+    // generation's offspring while the current one computes. The pipeline
+    // feeds one input vector, so there must be exactly one test case. A
+    // candidate reaching the target ends the generation early.
+    double run_pipelined(const search_budget &budget = search_budget()) {
+        assert(_cases.size() == 1);
+        _running = true;
+        std::chrono::steady_clock::duration last_generation(0);
+        std::vector<double> inputs = _cases[0]._inputs;
+        bool reached = false;
+        while (!_stop && !reached) {
+            uint32_t size = _pool.get_structures().size();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (budget._max_evaluations - _evaluations < size) break;
+            if (budget._deadline - start < last_generation) break;
+
+            reached = _pool.compute_pool_pipelined(inputs, [&](neural_structure *s) {
+                double score = _fitness.reduce(_fitness.accumulate(0, _fitness.score_sample(s->get_output_layer(), _cases[0])), 1);
+                _evaluations++;
+                offer(s->get_config(), score);
+                return score >= budget._target;
+            });
+            _generations++;
+            last_generation = std::chrono::steady_clock::now() - start;
+        }
+        _stop = false;
+        _running = false;
+        return best_score();
+    }
+
+    // Ask a running search to return after its current generation. Asked
+    // while no search runs, the next run() returns straight away.
+    void stop() { _stop = true; }
+
+    bool running() { return _running; }
+
+    // Copy out the best genome so far; false if there is none yet.
+    bool best(structure_config &config, double &score) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_best_score == -std::numeric_limits<double>::infinity()) return false;
+        config = _best;
+        score = _best_score;
+        return true;
+    }
+
+    double best_score() {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _best_score;
+    }
+
+    // Generation of the search in which the best genome was found.
+    uint64_t best_generation() {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _best_generation;
+    }
+
+    uint64_t evaluations() { return _evaluations; }
+
+    uint64_t generations() { return _generations; }
+
+private:
+    // Keep config if it beats the best so far.
+    void offer(const structure_config &config, double score) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (score <= _best_score) return;
+        _best = config;
+        _best_score = score;
+        _best_generation = _generations;
+    }
+
+    neural_pool                    &_pool;
+    const std::vector<test_case>   &_cases;
+    const fitness_function         &_fitness;
+    std::mt19937                    _gen;
+    std::atomic<bool>               _stop{false};
+    std::atomic<bool>               _running{false};
+    std::atomic<uint64_t>           _evaluations{0};
+    std::atomic<uint64_t>           _generations{0};
+
+    std::mutex                      _lock;
+    structure_config                _best;
+    double                          _best_score = -std::numeric_limits<double>::infinity();
+    uint64_t                        _best_generation = 0;
+};
+
+}
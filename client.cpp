@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include "inference_server.h"
+
+// Closed-loop load generator for nn_server.exe.
+//   nn_client.exe <socket> [connections] [requests per connection] [models] [inputs]
+// Each connection sends a request, waits for the reply, and repeats.
+// Prints round-trip p50/p99 and throughput.
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <socket> [connections] [requests] [models] [inputs]\n", argv[0]);
+        return 1;
+    }
+    uint32_t connections = argc > 2 ? atoi(argv[2]) : 8;
+    uint32_t requests = argc > 3 ? atoi(argv[3]) : 10000;
+    uint32_t models = argc > 4 ? atoi(argv[4]) : 1;
+    uint32_t inputs = argc > 5 ? atoi(argv[5]) : 5;
+
+    std::vector<std::vector<uint64_t> > latencies(connections);
+    std::vector<uint32_t> failures(connections, 0);
+    std::vector<std::thread> threads;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint32_t c = 0; c < connections; c++) {
+        threads.push_back(std::thread([&, c] {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+            if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0) {
+                printf("connect to %s failed\n", argv[1]);
+                failures[c] = requests;
+                close(fd);
+                return;
+            }
+            std::mt19937 gen(c);
+            std::uniform_real_distribution<> value(0, 1);
+            std::vector<double> in(inputs);
+            std::vector<double> out;
+            for (uint32_t i = 0; i < requests; i++) {
+                nn::inference_request_header request;
+                request._model = i % models;
+                request._input_count = inputs;
+                for (auto &v : in) v = value(gen);
+
+                std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+                nn::inference_response_header response;
+                if (!nn::write_fully(fd, &request, sizeof(request)) ||
+                    !nn::write_fully(fd, in.data(), in.size() * sizeof(double)) ||
+                    !nn::read_fully(fd, &response, sizeof(response))) {
+                    failures[c] += requests - i;
+                    break;
+                }
+                out.resize(response._output_count);
+                if (!nn::read_fully(fd, out.data(), out.size() * sizeof(double))) {
+                    failures[c] += requests - i;
+                    break;
+                }
+                if (response._status != nn::INFERENCE_OK) failures[c]++;
+                latencies[c].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - sent).count());
+            }
+            close(fd);
+        }));
+    }
+    for (auto &t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint64_t> all;
+    uint32_t failed = 0;
+    for (uint32_t c = 0; c < connections; c++) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        failed += failures[c];
+    }
+    uint64_t count = all.size();
+    uint64_t p50 = nn::percentile(all, 50);
+    uint64_t p99 = nn::percentile(all, 99);
+    printf("%lu requests, %u failed, %.0f req/s: p50 %.1fus p99 %.1fus\n",
+           (unsigned long)count, failed, count / seconds, p50 / 1000.0, p99 / 1000.0);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "evolution_strategy.h"
+#include "demo_problem.h"
+
+// Tunes the genes of one random tanh network on the demo problem with
+// evolution_strategy.
+//   demo_evolution_strategy.exe [steps] [pairs]
+// Exits 1 if the tuned network scores no better than where it started.
+
+int main(int argc, char **argv) {
+    uint32_t steps = argc > 1 ? atoi(argv[1]) : 150;
+    uint32_t pairs = argc > 2 ? atoi(argv[2]) : 40;
+
+    nn::neural_pool pool(1);
+    std::mt19937 gen(36);
+    nn::structure_config config(gen);
+    config.set_input_neuron_count(5);
+    config.set_output_neuron_count(3);
+    config.set_default_activation(nn::ACTIVATION_TANH);
+    do config.random(); while (config.get_layer_count() < 3);
+
+    std::vector<nn::test_case> cases = nn::demo_cases(64, 36);
+    nn::squared_error fitness;
+    nn::evolution_strategy es(pool, config, pairs, .05, .1, 36);
+    double start = es.evaluate(cases, fitness);
+    printf("%u layers, %u genes, start %f\n", es.get_config().get_layer_count(), es.get_config().gene_count(), start);
+    for (uint32_t s = 0; s < steps; s++) {
+        double mean = es.step(cases, fitness);
+        if (s % 50 == 49 || s + 1 == steps) {
+            printf("step %u: center %f, batch mean %f\n", s, es.evaluate(cases, fitness), mean);
+        }
+    }
+    double end = es.evaluate(cases, fitness);
+    if (end <= start) {
+        printf("no improvement: %f -> %f\n", start, end);
+        return 1;
+    }
+    return 0;
+}
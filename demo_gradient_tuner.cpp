@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "gradient_tuner.h"
+#include "demo_problem.h"
+
+// Fine-tunes one random threshold network on the binary demo problem with
+// gradient_tuner, annealing the surrogate's temperature, and scores the
+// real network (hard steps) on held-out cases before and after.
+//   demo_gradient_tuner.exe [epochs] [seed]
+// Exits 1 if the real network's held-out error does not fall.
+
+static double real_error(nn::structure_config &config, const std::vector<nn::test_case> &cases) {
+    std::mt19937 gen(0);
+    nn::neural_structure s(gen, config);
+    s.init();
+    nn::squared_error fitness;
+    return -nn::evaluate_structure(&s, cases, fitness);
+}
+
+int main(int argc, char **argv) {
+    uint32_t epochs = argc > 1 ? atoi(argv[1]) : 150;
+    uint32_t seed = argc > 2 ? atoi(argv[2]) : 37;
+
+    std::mt19937 gen(seed);
+    nn::structure_config config(gen, 4, 8);
+    config.set_input_neuron_count(5);
+    config.set_output_neuron_count(3);
+    config.set_default_activation(nn::ACTIVATION_THRESHOLD);
+    do config.random(); while (config.get_layer_count() < 3);
+
+    std::vector<nn::test_case> train = nn::demo_binary_cases(256, seed);
+    std::vector<nn::test_case> test = nn::demo_binary_cases(256, seed + 1);
+    nn::neural_pool pool(1);
+    nn::gradient_tuner tuner(pool, config);
+    double before = real_error(config, test);
+    printf("%u layers, %u genes, held-out error %f\n", config.get_layer_count(), config.gene_count(), before);
+    for (uint32_t e = 0; e < epochs; e++) {
+        double loss = tuner.train_epoch(train, seed);
+        if (e % 25 == 24 || e + 1 == epochs) {
+            printf("epoch %u: temperature %.4f, surrogate loss %f, real error %f, held-out %f\n",
+                   e, tuner.temperature(), loss, real_error(config, train), real_error(config, test));
+        }
+    }
+    double after = real_error(config, test);
+    if (after >= before) {
+        printf("held-out error did not fall: %f -> %f\n", before, after);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <random>
+#include <vector>
+#include "fitness_function.h"
+#include "neural_map.h"
+
+namespace nn {
+
+// Toy regression shared by the demo drivers, shaped for the pool's random
+// genomes (5 inputs, 3 outputs): the outputs should be the first input, the
+// mean of the next two, and one minus the fourth. The fifth input is noise.
+inline std::vector<test_case> demo_cases(uint32_t count, uint64_t seed) {
+    std::mt19937 gen((std::mt19937::result_type)splitmix64(seed));
+    std::uniform_real_distribution<> value(0, 1);
+    std::vector<test_case> cases(count);
+    for (uint32_t i = 0; i < count; i++) {
+        std::vector<double> &in = cases[i]._inputs;
+        for (uint32_t j = 0; j < 5; j++) in.push_back(value(gen));
+        cases[i]._expected.push_back(in[0]);
+        cases[i]._expected.push_back((in[1] + in[2]) / 2);
+        cases[i]._expected.push_back(1 - in[3]);
+    }
+    return cases;
+}
+
+// The same targets rounded to 0 or 1, for networks of threshold units.
+inline std::vector<test_case> demo_binary_cases(uint32_t count, uint64_t seed) {
+    std::vector<test_case> cases = demo_cases(count, seed);
+    for (auto &c : cases) {
+        for (auto &e : c._expected) e = e > .5 ? 1 : 0;
+    }
+    return cases;
+}
+
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "selection.h"
+#include "demo_problem.h"
+
+// Generational search on the demo problem with parents picked by
+// selection::tournament(). Every generation the top_k() elite and
+// assign_ranks() are checked against a full sort of the scores.
+//   demo_selection.exe [generations] [population]
+// Exits 1 if a check fails.
+
+int main(int argc, char **argv) {
+    uint32_t generations = argc > 1 ? atoi(argv[1]) : 40;
+    uint32_t population = argc > 2 ? atoi(argv[2]) : 500;
+    const uint32_t elite = 10;
+
+    nn::neural_pool pool(population);
+    pool.set_seed(34);
+    pool.init();
+    nn::selection selection(pool, 64);
+    std::vector<nn::test_case> cases = nn::demo_cases(64, 34);
+    nn::squared_error fitness;
+
+    std::vector<double> scores;
+    std::vector<uint32_t> best, ranks, parents, order(population);
+    double first = 0, best_score = -HUGE_VAL;
+    for (uint32_t g = 0; g < generations; g++) {
+        pool.evaluate_pool(cases, fitness, scores);
+
+        selection.top_k(scores, elite, best);
+        selection.assign_ranks(scores, elite, ranks);
+        for (uint32_t i = 0; i < population; i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+        if (!std::equal(best.begin(), best.end(), order.begin())) {
+            printf("generation %u: top_k disagrees with a full sort\n", g);
+            return 1;
+        }
+        for (uint32_t i = 0; i < population; i++) {
+            if (ranks[order[i]] != std::min(i, elite)) {
+                printf("generation %u: candidate %u ranked %u, expected %u\n", g, order[i], ranks[order[i]], std::min(i, elite));
+                return 1;
+            }
+        }
+
+        if (!g) first = scores[best[0]];
+        best_score = std::max(best_score, scores[best[0]]);
+        if (g % 10 == 0 || g + 1 == generations) {
+            printf("generation %u: best %f, elite cutoff %f\n", g, scores[best[0]], scores[best.back()]);
+        }
+
+        selection.tournament(scores, population, 4, g, parents);
+        pool.reproduce_pool(parents);
+    }
+    printf("best score %f, from %f in generation 0\n", best_score, first);
+    return 0;
+}
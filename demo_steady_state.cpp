@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "steady_state.h"
+#include "demo_problem.h"
+
+// Runs steady_state_search on the demo problem under an evaluation budget.
+//   demo_steady_state.exe [evaluations] [population] [workers]
+// Exits 1 if the budget is overrun, or if the population handed back does
+// not hold a candidate with the best score the search reports.
+
+int main(int argc, char **argv) {
+    uint64_t evaluations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+    uint32_t population = argc > 2 ? atoi(argv[2]) : 100;
+    uint32_t workers = argc > 3 ? atoi(argv[3]) : 3;
+
+    nn::neural_pool pool(population);
+    pool.set_seed(48);
+    pool.init();
+    std::vector<nn::test_case> cases = nn::demo_cases(64, 48);
+    nn::squared_error fitness;
+
+    std::vector<double> scores;
+    pool.evaluate_pool(cases, fitness, scores);
+    printf("initial best %f\n", scores[nn::arg_max(scores)]);
+
+    nn::steady_state_search search(pool, cases, fitness, workers, 3);
+    search.set_seed(48);
+    nn::search_budget budget;
+    budget._max_evaluations = evaluations;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double best = search.run(budget);
+    printf("best %f after %llu evaluations, %llu replacements, %.3fs\n", best,
+           (unsigned long long)search.evaluations(), (unsigned long long)search.replacements(),
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    if (search.evaluations() > evaluations) {
+        printf("budget of %llu evaluations overrun\n", (unsigned long long)evaluations);
+        return 1;
+    }
+    pool.evaluate_pool(cases, fitness, scores);
+    if (scores[nn::arg_max(scores)] != best) {
+        printf("final population's best is %f, not %f\n", scores[nn::arg_max(scores)], best);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "surrogate_search.h"
+#include "demo_problem.h"
+
+// Runs surrogate_search on the demo problem under an evaluation budget,
+// once scoring every child and once scoring only the quarter the
+// surrogate predicts best, from the same starting population.
+//   demo_surrogate_search.exe [evaluations] [population]
+// Exits 1 if a budget is overrun or the surrogate never screened a child.
+
+static bool search(double evaluate_fraction, uint64_t evaluations, uint32_t population,
+                   const std::vector<nn::test_case> &cases, const nn::fitness_function &fitness) {
+    nn::neural_pool pool(population);
+    pool.set_seed(50);
+    pool.init();
+    nn::surrogate_search search(pool, cases, fitness, evaluate_fraction, evaluate_fraction < 1 ? .05 : 0);
+    search.set_seed(50);
+    nn::search_budget budget;
+    budget._max_evaluations = evaluations;
+    double best = search.run(budget);
+    printf("evaluate %.2f: best %f, %llu evaluations, %llu generations, %llu screened, "
+           "%llu replacements, prediction error %f\n", evaluate_fraction, best,
+           (unsigned long long)search.evaluations(), (unsigned long long)search.generations(),
+           (unsigned long long)search.screened(), (unsigned long long)search.replacements(),
+           search.prediction_error());
+    if (search.evaluations() > evaluations) {
+        printf("budget of %llu evaluations overrun\n", (unsigned long long)evaluations);
+        return false;
+    }
+    if (evaluate_fraction < 1 && !search.screened()) {
+        printf("the surrogate screened no children\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint64_t evaluations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 8000;
+    uint32_t population = argc > 2 ? atoi(argv[2]) : 40;
+
+    std::vector<nn::test_case> cases = nn::demo_cases(256, 50);
+    nn::squared_error fitness;
+    if (!search(1, evaluations, population, cases, fitness)) return 1;
+    if (!search(.25, evaluations, population, cases, fitness)) return 1;
+    return 0;
+}
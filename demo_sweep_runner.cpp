@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "sweep_runner.h"
+#include "demo_problem.h"
+
+// Sweeps the genome limits on the demo problem with sweep_runner: every
+// combination of max layer count and max node count, the larger pools
+// with twice the share. The sweep runs on one executor thread and then on
+// `threads`; pools are seeded, so both must give the same results.
+//   demo_sweep_runner.exe [generations] [threads] [results.tsv]
+// Prints the results table, and writes it to results.tsv if given. Exits 1
+// if the two sweeps disagree.
+
+static void sweep(uint32_t threads, uint64_t generations, const std::vector<nn::test_case> &cases,
+                  const nn::fitness_function &fitness, std::vector<nn::experiment_result> &results,
+                  const char *path) {
+    nn::work_stealing_executor executor(threads);
+    nn::sweep_runner runner(executor, cases, fitness);
+    for (uint32_t layers : {3u, 5u, 7u}) {
+        for (uint32_t nodes : {6u, 12u}) {
+            for (uint32_t pool : {10u, 40u}) {
+                nn::experiment e;
+                char name[64];
+                snprintf(name, sizeof(name), "L%u_N%u_P%u", layers, nodes, pool);
+                e._name = name;
+                e._max_layer_count = layers;
+                e._max_node_count = nodes;
+                e._pool_size = pool;
+                e._seed = layers * 100 + nodes;
+                e._max_generations = generations;
+                e._share = pool == 40 ? 2 : 1;
+                runner.add(e);
+            }
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    runner.run();
+    printf("%u threads: %.3fs\n", threads,
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    results.clear();
+    for (uint32_t i = 0; i < runner.size(); i++) results.push_back(runner.result(i));
+    if (threads > 1) {
+        runner.write_results(stdout);
+        if (path) runner.write_results(path);
+    }
+}
+
+int main(int argc, char **argv) {
+    uint64_t generations = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100;
+    uint32_t threads = argc > 2 ? atoi(argv[2]) : 3;
+    const char *path = argc > 3 ? argv[3] : nullptr;
+
+    std::vector<nn::test_case> cases = nn::demo_cases(32, 46);
+    nn::squared_error fitness;
+    std::vector<nn::experiment_result> serial, parallel;
+    sweep(1, generations, cases, fitness, serial, nullptr);
+    sweep(std::max(2u, threads), generations, cases, fitness, parallel, path);
+
+    for (uint32_t i = 0; i < serial.size(); i++) {
+        if (serial[i]._best_score != parallel[i]._best_score ||
+            serial[i]._best_generation != parallel[i]._best_generation ||
+            serial[i]._generations != parallel[i]._generations) {
+            printf("experiment %u differs between the serial and parallel sweeps\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "neural_pool.h"
+
+namespace nn {
+
+// Evolution strategies over the genes of one fixed topology.
+//
+// Each step samples `pairs` Gaussian directions e_i over the whole gene
+// vector (every threshold and weight) and evaluates the antithetic pair
+// theta + sigma * e_i, theta - sigma * e_i, all 2 * pairs candidates as one
+// batch on the pool's workers. Fitnesses are shaped into centered ranks and
+// the center moves along
+//     learning_rate / (pairs * sigma) * sum_i (u(+e_i) - u(-e_i)) / 2 * e_i
+// Directions are never stored: each one is regenerated from a stream on
+// (seed, step, pair) when it is needed, so memory is one gene vector per
+// worker whatever the batch size.
+class evolution_strategy {
+
+public:
+    evolution_strategy(neural_pool &pool,
+                       const structure_config &config,
+                       uint32_t pairs = 50,
+                       double sigma = .05,
+                       double learning_rate = .02,
+                       uint64_t seed = 0)
+        : _pool(pool),
+          _center(config),
+          _pairs(pairs),
+          _sigma(sigma),
+          _learning_rate(learning_rate),
+          _seed(seed) {}
+
+    // One ES update. Returns the mean raw fitness of the batch.
+    double step(const std::vector<test_case> &cases, const fitness_function &fitness) {
+        uint32_t genes = _center.gene_count();
+        uint32_t count = 2 * _pairs;
+        uint32_t workers = std::max(1u, std::min(_pool.max_workers(), _pairs));
+        prepare_workers(workers, genes);
+
+        // Evaluate both sides of every pair.
+        std::vector<double> scores(count);
+        const structure_config &center_config = _center;
+        _pool.parallel_for(workers, _pairs, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            worker_state &w = _workers[worker];
+            for (uint32_t i = begin; i < end; i++) {
+                direction(i, w._noise);
+                for (int side = 0; side < 2; side++) {
+                    double scale = side ? -_sigma : _sigma;
+                    double *target = w._network->get_config().genes();
+                    const double *center = center_config.genes();
+                    for (uint32_t g = 0; g < genes; g++) {
+                        target[g] = center[g] + scale * w._noise[g];
+                    }
+                    w._network->rebuild();
+                    scores[2 * i + side] = evaluate_structure(w._network, cases, fitness);
+                }
+            }
+        });
+
+        std::vector<double> utility;
+        centered_ranks(scores, utility);
+
+        // Each worker sums its pairs' contributions, then the partial sums
+        // are added on the caller.
+        _pool.parallel_for(workers, _pairs, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            worker_state &w = _workers[worker];
+            std::fill(w._gradient.begin(), w._gradient.end(), 0);
+            for (uint32_t i = begin; i < end; i++) {
+                direction(i, w._noise);
+                double weight = (utility[2 * i] - utility[2 * i + 1]) / 2;
+                for (uint32_t g = 0; g < genes; g++) {
+                    w._gradient[g] += weight * w._noise[g];
+                }
+            }
+        });
+
+        double *center = _center.genes();
+        double scale = _learning_rate / (_pairs * _sigma);
+        for (uint32_t worker = 0; worker < workers; worker++) {
+            const std::vector<double> &gradient = _workers[worker]._gradient;
+            for (uint32_t g = 0; g < genes; g++) {
+                center[g] += scale * gradient[g];
+            }
+        }
+        _step++;
+
+        double mean = 0;
+        for (auto &s : scores) mean += s;
+        return mean / count;
+    }
+
+    // Fitness of the current center.
+    double evaluate(const std::vector<test_case> &cases, const fitness_function &fitness) {
+        neural_structure s(_gen, _center);
+        s.init();
+        return evaluate_structure(&s, cases, fitness);
+    }
+
+    structure_config &get_config() { return _center; }
+
+    ~evolution_strategy() {
+        for (auto &w : _workers) delete w._network;
+    }
+
+private:
+    struct worker_state {
+        neural_structure       *_network = nullptr;
+        std::vector<double>     _noise;
+        std::vector<double>     _gradient;
+    };
+
+    void prepare_workers(uint32_t workers, uint32_t genes) {
+        while (_workers.size() < workers) {
+            _workers.push_back(worker_state());
+            _workers.back()._network = new neural_structure(_gen, _center);
+        }
+        for (auto &w : _workers) {
+            w._network->get_config() = _center;
+            w._noise.resize(genes);
+            w._gradient.resize(genes);
+        }
+    }
+
+    // Direction for pair i of the current step.
+    void direction(uint32_t pair, std::vector<double> &noise) {
+        uint64_t z = splitmix64(splitmix64(_seed ^ splitmix64(_step)) ^ pair);
+        std::mt19937 gen((std::mt19937::result_type)(z ^ (z >> 32)));
+        std::normal_distribution<> normal(0, 1);
+        for (auto &n : noise) n = normal(gen);
+    }
+
+    // Replace raw fitnesses by their rank scaled into [-0.5, 0.5], which
+    // makes the update insensitive to the fitness scale and to outliers.
+    static void centered_ranks(const std::vector<double> &scores, std::vector<double> &utility) {
+        uint32_t count = scores.size();
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < count; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return scores[a] != scores[b] ? scores[a] < scores[b] : a < b;
+        });
+        // Equal scores share their mean rank so ties cancel within a pair.
+        utility.resize(count);
+        for (uint32_t r = 0; r < count;) {
+            uint32_t end = r;
+            while (end < count && scores[order[end]] == scores[order[r]]) end++;
+            double rank = (r + end - 1) / 2.0;
+            for (; r < end; r++) {
+                utility[order[r]] = count > 1 ? rank / (count - 1) - .5 : 0;
+            }
+        }
+    }
+
+    neural_pool                &_pool;
+    std::mt19937                _gen;
+    structure_config            _center;
+    uint32_t                    _pairs = 0;
+    double                      _sigma = 0;
+    double                      _learning_rate = 0;
+    uint64_t                    _seed = 0;
+    uint64_t                    _step = 0;
+    std::vector<worker_state>   _workers;   // index: worker
+};
+
+}
@@ -1,13 +1,29 @@
 #include <assert.h>
 #include "neural_pool.h"
+#include "anytime_search.h"
 
 namespace nn {
 
+// 1 when the watched output neuron fires, 0 otherwise.
+class output_fires : public fitness_function {
+public:
+    output_fires(uint32_t node) : _node(node) {}
+
+    double score_sample(neural_layer *output, const test_case &sample) const {
+        return output->get_nodes()[_node]->value() == 1 ? 1 : 0;
+    }
+
+private:
+    uint32_t _node;
+};
+
 class fitness_measure {
 public:
     fitness_measure(neural_pool &pool) : _pool(pool) {}
 
-    double evaluate_fitness() { 
+    // Evolve until some candidate fires output 2 or the budget runs out.
+    // Returns 1 on a decision, otherwise the best score reached.
+    double evaluate_fitness(const search_budget &budget = search_budget()) {
         std::vector<double> inputs;
         inputs.push_back(0.04);
         inputs.push_back(0.24);
@@ -15,30 +31,43 @@ public:
         inputs.push_back(0.91);
         inputs.push_back(0.25);
 
+        std::vector<test_case> cases(1);
+        cases[0]._inputs = inputs;
+        output_fires decision(2);
+
         printf("Fitness called\n");
-        std::vector<neural_structure *> &structures = _pool.get_structures();
-        while(1) {
-            for (const auto &s : structures) {
-                neural_layer *output = s->get_output_layer();
-                if (output->get_nodes()[2]->value() == 1) {
-                //for (const auto &n : output->get_nodes()) {
-                //    if (n->value() == 1) {
-                        printf("Decision made!\n");
-                        return 1;
-                    }
-                //}
-            }
-            for (auto &s : structures) {
-                s->mutate();
-                _pool.feed_inputs(inputs);
-
-            }
-            _pool.compute_pool();
-            //printf("Recomputation\n");
-            //_pool.enumerate_pool();
-        }
-        return 0;
-    }    
+        anytime_search search(_pool, cases, decision);
+        search_budget until_decision = budget;
+        until_decision._target = 1;
+        double best = search.run(until_decision);
+        if (best == 1) printf("Decision made!\n");
+        else printf("No decision after %llu generations\n", (unsigned long long)search.generations());
+        return best;
+    }
+
+    // Same search as evaluate_fitness(), but offspring for the next
+    // generation are built while the current one is still being computed.
+    double evaluate_fitness_pipelined(const search_budget &budget = search_budget()) {
+        std::vector<double> inputs;
+        inputs.push_back(0.04);
+        inputs.push_back(0.24);
+        inputs.push_back(0.84);
+        inputs.push_back(0.91);
+        inputs.push_back(0.25);
+
+        std::vector<test_case> cases(1);
+        cases[0]._inputs = inputs;
+        output_fires decision(2);
+
+        printf("Pipelined fitness called\n");
+        anytime_search search(_pool, cases, decision);
+        search_budget until_decision = budget;
+        until_decision._target = 1;
+        double best = search.run_pipelined(until_decision);
+        if (best == 1) printf("Decision made!\n");
+        else printf("No decision after %llu generations\n", (unsigned long long)search.generations());
+        return best;
+    }
 
 private:
     neural_pool &_pool;
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+#include "neural_structure.h"
+
+namespace nn {
+
+struct test_case {
+    std::vector<double> _inputs;
+    std::vector<double> _expected;  // one value per output neuron
+};
+
+// Pluggable fitness: a per-sample scorer plus a reduction over all samples.
+// Fitness is always "higher is better". Implementations are called
+// concurrently from pool workers and must not keep mutable state.
+class fitness_function {
+public:
+    virtual ~fitness_function() {}
+
+    // Score one computed network (its output layer) against one test case.
+    virtual double score_sample(neural_layer *output, const test_case &sample) const = 0;
+
+    // Fold one sample score into the running total; defaults to a sum.
+    virtual double accumulate(double total, double score) const { return total + score; }
+
+    // Turn the running total over `samples` cases into the fitness; defaults
+    // to the mean.
+    virtual double reduce(double total, uint32_t samples) const {
+        return samples ? total / samples : 0;
+    }
+};
+
+// Run every test case through s and reduce the per-sample scores.
+inline double evaluate_structure(neural_structure *s,
+                                 const std::vector<test_case> &cases,
+                                 const fitness_function &fitness) {
+    double total = 0;
+    for (auto &c : cases) {
+        s->bind_inputs(c._inputs.data(), c._inputs.size());
+        s->compute_network();
+        total = fitness.accumulate(total, fitness.score_sample(s->get_output_layer(), c));
+    }
+    return fitness.reduce(total, cases.size());
+}
+
+inline uint32_t arg_max(const std::vector<double> &values) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < values.size(); i++) {
+        if (values[i] > values[best]) best = i;
+    }
+    return best;
+}
+
+// Fraction of cases where the strongest output neuron is the expected class,
+// the class being the largest entry of _expected. Ties go to the lowest index.
+class classification_accuracy : public fitness_function {
+public:
+    double score_sample(neural_layer *output, const test_case &sample) const {
+        std::vector<neural_node *> &nodes = output->get_nodes();
+        uint32_t predicted = 0;
+        for (uint32_t i = 1; i < nodes.size(); i++) {
+            if (nodes[i]->value() > nodes[predicted]->value()) predicted = i;
+        }
+        return predicted == arg_max(sample._expected) ? 1 : 0;
+    }
+};
+
+// Negative mean squared error, so a perfect network scores 0.
+class squared_error : public fitness_function {
+public:
+    double score_sample(neural_layer *output, const test_case &sample) const {
+        std::vector<neural_node *> &nodes = output->get_nodes();
+        assert(nodes.size() == sample._expected.size());
+        double sum = 0;
+        for (uint32_t i = 0; i < nodes.size(); i++) {
+            double d = nodes[i]->value() - sample._expected[i];
+            sum += d * d;
+        }
+        return sum / nodes.size();
+    }
+
+    double reduce(double total, uint32_t samples) const {
+        return samples ? -total / samples : 0;
+    }
+};
+
+}
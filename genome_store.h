@@ -0,0 +1,249 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include "neural_map.h"
+#include "packed_genome.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace nn {
+
+// Bump whenever the genome layout or the record format changes; open()
+// rejects stores of any other version.
+const uint32_t GENOME_STORE_VERSION = 1;
+
+// Start of every store, ahead of its first record.
+struct genome_store_header {
+    char        _magic[8] = { 'N', 'N', 'G', 'E', 'N', 'E', 'S', 0 };
+    uint32_t    _version = GENOME_STORE_VERSION;
+    uint32_t    _reserved = 0;      // keeps the records double aligned
+};
+static_assert(sizeof(genome_store_header) % sizeof(double) == 0, "records must stay double aligned");
+
+// Fixed part of every record. An FP64 record is followed by _gene_count
+// doubles; a 16 bit record by the shape doubles (header, layer sizes,
+// activations, sources), then the remaining genes packed and padded to 8
+// bytes.
+struct genome_record_header {
+    uint32_t        _gene_count = 0;
+    uint32_t        _format = GENE_FP64;
+    mutation_chart  _chart;
+};
+static_assert(sizeof(genome_record_header) % sizeof(double) == 0, "records must stay double aligned");
+
+// Append-only file of flat genomes for populations larger than RAM.
+//
+// A store is written once, front to back, with append() and then sealed,
+// after which it is memory-mapped read-only and records are decoded straight
+// out of the page cache. Only an 8 byte offset per record stays resident.
+// The evolution loop reads generation g from one store while appending
+// generation g+1 to another, so both sides stay sequential.
+//
+// Stores created with GENE_FP16 or GENE_BF16 keep genes in 16 bits (see
+// packed_genome.h for the error bounds) and take about a quarter of the
+// space; load() expands them back to doubles.
+class genome_store {
+
+public:
+    genome_store() {}
+
+    bool create(const char *path, gene_format format = GENE_FP64) {
+        close();
+        _path = path;
+        _format = format;
+        _writer = fopen(path, "wb");
+        if (!_writer) {
+            printf("genome_store: unable to create %s\n", path);
+            return false;
+        }
+        genome_store_header header;
+        if (fwrite(&header, sizeof(header), 1, _writer) != 1) {
+            printf("genome_store: write to %s failed\n", path);
+            return false;
+        }
+        _write_offset = sizeof(header);
+        return true;
+    }
+
+    bool append(structure_config &config) {
+        assert(_writer);
+        const std::vector<double> &genome = config.genome();
+        genome_record_header header;
+        header._gene_count = genome.size();
+        header._format = _format;
+        header._chart = config.get_mutation_chart();
+        uint32_t exact = _format == GENE_FP64 ? genome.size() : shape_size(genome.data());
+        bool ok = fwrite(&header, sizeof(header), 1, _writer) == 1 &&
+                  fwrite(genome.data(), sizeof(double), exact, _writer) == exact;
+        if (ok && exact < genome.size()) {
+            _packed.assign(padded(genome.size() - exact), 0);
+            pack_genes(_format, genome.data() + exact, _packed.data(), genome.size() - exact);
+            ok = fwrite(_packed.data(), sizeof(uint16_t), _packed.size(), _writer) == _packed.size();
+        }
+        if (!ok) {
+            printf("genome_store: write to %s failed\n", _path.c_str());
+            return false;
+        }
+        _offsets.push_back(_write_offset);
+        _write_offset += record_size(header, genome.data());
+        return true;
+    }
+
+    // Finish writing and map the file for reading.
+    bool seal() {
+        assert(_writer);
+        bool ok = fclose(_writer) == 0;
+        _writer = nullptr;
+        return ok && map();
+    }
+
+    // Map an existing store and rebuild its record index. Fails on a file
+    // that is not a store of this version.
+    bool open(const char *path) {
+        close();
+        _path = path;
+        if (!map()) return false;
+        genome_store_header expected;
+        const genome_store_header *file = (const genome_store_header *)_data;
+        if (_length < sizeof(*file) || memcmp(file->_magic, expected._magic, sizeof(expected._magic)) ||
+            file->_version != GENOME_STORE_VERSION) {
+            printf("genome_store: %s is not a version %u genome store\n", path, GENOME_STORE_VERSION);
+            close();
+            return false;
+        }
+        uint64_t offset = sizeof(*file);
+        while (offset + sizeof(genome_record_header) + sizeof(double) <= _length) {
+            const genome_record_header *header = (const genome_record_header *)(_data + offset);
+            _offsets.push_back(offset);
+            offset += record_size(*header, (const double *)(header + 1));
+        }
+        return offset == _length;
+    }
+
+    // Decode record i into config; the caller rebuilds any network from it.
+    void load(uint64_t i, structure_config &config) {
+        const char *record = _data + _offsets[i];
+        const genome_record_header *header = (const genome_record_header *)record;
+        const double *body = (const double *)(record + sizeof(genome_record_header));
+        if (header->_format == GENE_FP64) {
+            config.load_genome(body, header->_gene_count);
+        }
+        else {
+            uint32_t exact = shape_size(body);
+            std::vector<double> genome(body, body + exact);
+            genome.resize(header->_gene_count);
+            unpack_genes((gene_format)header->_format, (const uint16_t *)(body + exact),
+                         &genome[exact], header->_gene_count - exact);
+            config.load_genome(genome.data(), genome.size());
+        }
+        config.get_mutation_chart() = header->_chart;
+    }
+
+    uint64_t size() { return _offsets.size(); }
+
+    uint64_t bytes() { return _writer ? _write_offset : _length; }
+
+    void close() {
+        if (_writer) fclose(_writer);
+        _writer = nullptr;
+        unmap();
+        _offsets.clear();
+    }
+
+    ~genome_store() { close(); }
+
+private:
+    genome_store(const genome_store &) = delete;
+    genome_store &operator=(const genome_store &) = delete;
+
+    // Doubles in a genome before its first gene.
+    static uint32_t shape_size(const double *genome) {
+        return GENOME_HEADER_SIZE + 3 * (uint32_t)genome[GENOME_LAYER_COUNT];
+    }
+
+    // 16 bit genes are padded so the next record stays double aligned.
+    static uint32_t padded(uint32_t count) { return (count + 3) & ~3u; }
+
+    static uint64_t record_size(const genome_record_header &header, const double *body) {
+        if (header._format == GENE_FP64) {
+            return sizeof(header) + header._gene_count * sizeof(double);
+        }
+        uint32_t exact = shape_size(body);
+        return sizeof(header) + exact * sizeof(double) + padded(header._gene_count - exact) * sizeof(uint16_t);
+    }
+
+#ifdef __linux__
+    bool map() {
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            printf("genome_store: unable to open %s\n", _path.c_str());
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        _length = st.st_size;
+        if (_length) {
+            void *data = mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                printf("genome_store: unable to map %s\n", _path.c_str());
+                ::close(fd);
+                return false;
+            }
+            // Workers stream contiguous slices, so let the kernel read ahead.
+            madvise(data, _length, MADV_SEQUENTIAL);
+            _data = (const char *)data;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void unmap() {
+        if (_data) munmap((void *)_data, _length);
+        _data = nullptr;
+        _length = 0;
+    }
+#else
+    bool map() {
+        FILE *f = fopen(_path.c_str(), "rb");
+        if (!f) {
+            printf("genome_store: unable to open %s\n", _path.c_str());
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        _length = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        _buffer.resize(_length);
+        bool ok = fread(_buffer.data(), 1, _length, f) == _length;
+        fclose(f);
+        _data = _buffer.data();
+        return ok;
+    }
+
+    void unmap() {
+        _buffer.clear();
+        _data = nullptr;
+        _length = 0;
+    }
+
+    std::vector<char>       _buffer;
+#endif
+
+    std::string             _path;
+    gene_format             _format = GENE_FP64;
+    std::vector<uint16_t>   _packed;    // append() scratch
+    FILE                   *_writer = nullptr;
+    uint64_t                _write_offset = 0;
+    const char             *_data = nullptr;
+    uint64_t                _length = 0;
+    std::vector<uint64_t>   _offsets;   // index: record, value: byte offset in the file
+};
+
+}
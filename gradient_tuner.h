@@ -0,0 +1,308 @@
+#pragma once
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "neural_pool.h"
+#include "neural_simd.h"
+
+namespace nn {
+
+// Backpropagation fine-tuning of an evolved genome.
+//
+// The hard threshold is not differentiable, so while training a threshold
+// layer uses the smooth surrogate
+//     sigmoid((softsign(z) - threshold) / temperature)
+// which tends to the real step as temperature goes to 0. The other
+// activations use their exact derivatives. Gradients reach the raw genes
+// through the softsign weight squash, and thresholds are trained too.
+//
+// What is learned at a fixed temperature does not carry over to the step,
+// so the temperature is annealed geometrically from its start to its final
+// value over anneal_epochs epochs, then held. The true surrogate derivative
+// grows as 1 / temperature and would blow up the steps as it falls, so the
+// derivative through a threshold always divides by the start temperature:
+// only the surrogate's shape sharpens.
+//
+// Each mini-batch is split across the pool's workers, each accumulating
+// the mean squared error gradient for its samples into its own buffer. The
+// buffers are summed and applied with SGD plus momentum directly to the
+// genome, so the tuned weights are always in the config.
+class gradient_tuner {
+
+public:
+    gradient_tuner(neural_pool &pool,
+                   structure_config &config,
+                   double learning_rate = .5,
+                   uint32_t batch_size = 32,
+                   double temperature = .2,
+                   double momentum = .9,
+                   double final_temperature = .01,
+                   uint32_t anneal_epochs = 100)
+        : _pool(pool),
+          _config(config),
+          _learning_rate(learning_rate),
+          _batch_size(batch_size),
+          _temperature(temperature),
+          _momentum(momentum) {
+        set_annealing(temperature, final_temperature, anneal_epochs);
+    }
+
+    // One pass over data in a shuffled order. Returns the mean surrogate loss.
+    double train_epoch(const std::vector<test_case> &data, uint64_t seed = 0) {
+        double progress = _anneal_epochs ? std::min(1.0, (double)(_epoch - _anneal_begin) / _anneal_epochs) : 1;
+        _temperature = _start_temperature * std::pow(_final_temperature / _start_temperature, progress);
+        std::vector<uint32_t> order(data.size());
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::mt19937 gen((std::mt19937::result_type)splitmix64(seed ^ splitmix64(_epoch++)));
+        std::shuffle(order.begin(), order.end(), gen);
+
+        double loss = 0;
+        for (uint32_t begin = 0; begin < order.size(); begin += _batch_size) {
+            uint32_t end = std::min<uint32_t>(begin + _batch_size, order.size());
+            loss += train_batch(data, order, begin, end);
+        }
+        return order.empty() ? 0 : loss / order.size();
+    }
+
+    // Mean surrogate loss over data, without updating.
+    double loss(const std::vector<test_case> &data) {
+        prepare(1);
+        worker_state &w = _workers[0];
+        double total = 0;
+        for (auto &sample : data) {
+            total += forward(w, sample);
+        }
+        return data.empty() ? 0 : total / data.size();
+    }
+
+    // Anneal from start to final over the next `epochs` epochs.
+    void set_annealing(double start, double final, uint32_t epochs) {
+        _temperature = _start_temperature = start;
+        _final_temperature = final;
+        _anneal_epochs = epochs;
+        _anneal_begin = _epoch;
+    }
+
+    // Hold the temperature from now on.
+    void set_temperature(double temperature) { set_annealing(temperature, temperature, 0); }
+
+    double temperature() { return _temperature; }
+
+private:
+    struct worker_state {
+        std::vector<std::vector<double> >   _z;         // index: layer, node; pre-activation
+        std::vector<std::vector<double> >   _a;         // index: layer, node; activation
+        std::vector<std::vector<double> >   _delta;     // index: layer, node; dLoss/dz
+        std::vector<std::vector<double> >   _upstream;  // index: layer, node; dLoss/da
+        std::vector<double>                 _gradient;  // laid out like structure_config::genes()
+        double                              _loss = 0;
+    };
+
+    // Run one mini-batch and apply its update. Returns the summed loss of
+    // the batch's samples.
+    double train_batch(const std::vector<test_case> &data, const std::vector<uint32_t> &order,
+                       uint32_t begin, uint32_t end) {
+        uint32_t count = end - begin;
+        uint32_t workers = std::max(1u, std::min(_pool.max_workers(), count));
+        prepare(workers);
+        _pool.parallel_for(workers, count, [&](uint32_t worker, uint32_t first, uint32_t last) {
+            worker_state &w = _workers[worker];
+            std::fill(w._gradient.begin(), w._gradient.end(), 0);
+            w._loss = 0;
+            for (uint32_t i = first; i < last; i++) {
+                const test_case &sample = data[order[begin + i]];
+                w._loss += forward(w, sample);
+                backward(w, sample);
+            }
+        });
+
+        double loss = 0;
+        double *genes = _config.genes();
+        double rate = _learning_rate / count;
+        for (uint32_t g = 0; g < _velocity.size(); g++) {
+            double gradient = 0;
+            for (uint32_t worker = 0; worker < workers; worker++) {
+                gradient += _workers[worker]._gradient[g];
+            }
+            _velocity[g] = _momentum * _velocity[g] - rate * gradient;
+            genes[g] += _velocity[g];
+        }
+        for (uint32_t worker = 0; worker < workers; worker++) {
+            loss += _workers[worker]._loss;
+        }
+        refresh_weights();
+        return loss;
+    }
+
+    // Sizes every buffer to the config, starting momentum and the squashed
+    // weights afresh if its shape changed since the last call.
+    void prepare(uint32_t workers) {
+        const structure_config &config = _config;
+        uint32_t layers = config.get_layer_count();
+        std::vector<uint32_t> shape;
+        for (uint32_t l = 0; l < layers; l++) {
+            shape.push_back(config.node_count(l));
+            shape.push_back(config.input_count(l));
+        }
+        if (shape != _shape || _velocity.size() != config.gene_count()) {
+            _shape.swap(shape);
+            _velocity.assign(config.gene_count(), 0);
+            refresh_weights();
+        }
+        while (_workers.size() < workers) _workers.push_back(worker_state());
+        for (auto &w : _workers) {
+            w._z.resize(layers);
+            w._a.resize(layers);
+            w._delta.resize(layers);
+            w._upstream.resize(layers);
+            for (uint32_t l = 0; l < layers; l++) {
+                w._z[l].resize(_config.node_count(l));
+                w._a[l].resize(_config.node_count(l));
+                w._delta[l].resize(_config.node_count(l));
+                w._upstream[l].resize(_config.node_count(l));
+            }
+            w._gradient.resize(_config.gene_count());
+        }
+    }
+
+    // Squashed weights as the network sees them, shared read-only by workers.
+    void refresh_weights() {
+        const structure_config &config = _config;
+        uint32_t layers = config.get_layer_count();
+        _effective.resize(layers);
+        for (uint32_t l = 1; l < layers; l++) {
+            uint32_t size = config.node_count(l) * config.input_count(l);
+            const double *raw = config.weights(l);
+            _effective[l].resize(size);
+            for (uint32_t i = 0; i < size; i++) {
+                _effective[l][i] = softsign(raw[i]);
+            }
+        }
+    }
+
+    double surrogate(activation_type type, double z, double threshold) {
+        if (type == ACTIVATION_THRESHOLD) {
+            return 1 / (1 + std::exp(-(softsign(z) - threshold) / _temperature));
+        }
+        return activate(type, z, threshold);
+    }
+
+    // d activation / dz, given z and the activation a; for a threshold, at
+    // the start temperature.
+    double surrogate_derivative(activation_type type, double z, double a) {
+        double s = 1 + std::abs(z);
+        switch (type) {
+        case ACTIVATION_THRESHOLD:  return a * (1 - a) / _start_temperature / (s * s);
+        case ACTIVATION_SOFTSIGN:   return 1 / (s * s);
+        case ACTIVATION_RELU:       return z > 0 ? 1 : 0;
+        case ACTIVATION_TANH: {
+            if (std::abs(z) > 3) return 0;
+            double z2 = z * z;
+            double d = 27 + 9 * z2;
+            return ((27 + 3 * z2) * d - z * (27 + z2) * 18 * z) / (d * d);
+        }
+        default:                    return 1;
+        }
+    }
+
+    double forward(worker_state &w, const test_case &sample) {
+        const structure_config &config = _config;
+        uint32_t layers = config.get_layer_count();
+        assert(sample._inputs.size() == w._a[0].size());
+        assert(sample._expected.size() == w._a[layers - 1].size());
+        std::copy(sample._inputs.begin(), sample._inputs.end(), w._a[0].begin());
+        for (uint32_t l = 1; l < layers; l++) {
+            uint32_t nodes = config.node_count(l);
+            uint32_t inputs = config.input_count(l);
+            uint64_t sources = config.sources(l);
+            activation_type type = config.activation(l);
+            const double *thresholds = config.thresholds(l);
+            for (uint32_t n = 0; n < nodes; n++) {
+                const double *row = &_effective[l][n * inputs];
+                double z = 0;
+                for (uint32_t s = 0; s < l; s++) {
+                    if (!(sources & layer_bit(s))) continue;
+                    z += simd::dot(row, w._a[s].data(), w._a[s].size());
+                    row += w._a[s].size();
+                }
+                w._z[l][n] = z;
+                w._a[l][n] = surrogate(type, z, thresholds[n]);
+            }
+        }
+        double loss = 0;
+        const std::vector<double> &out = w._a[layers - 1];
+        for (uint32_t n = 0; n < out.size(); n++) {
+            double d = out[n] - sample._expected[n];
+            loss += d * d;
+        }
+        return loss / out.size();
+    }
+
+    // Layers are visited last to first, so every layer has collected the
+    // gradient from all layers it feeds before its own turn.
+    void backward(worker_state &w, const test_case &sample) {
+        const structure_config &config = _config;
+        uint32_t layers = config.get_layer_count();
+        uint32_t last = layers - 1;
+        uint32_t outputs = config.node_count(last);
+        for (auto &u : w._upstream) std::fill(u.begin(), u.end(), 0);
+        for (uint32_t n = 0; n < outputs; n++) {
+            w._upstream[last][n] = 2 * (w._a[last][n] - sample._expected[n]) / outputs;
+        }
+
+        const double *genes = config.genes();
+        for (uint32_t l = last; l >= 1; l--) {
+            uint32_t nodes = config.node_count(l);
+            uint32_t inputs = config.input_count(l);
+            uint64_t sources = config.sources(l);
+            activation_type type = config.activation(l);
+            const std::vector<double> &upstream = w._upstream[l];
+            uint32_t threshold_offset = config.thresholds(l) - genes;
+            uint32_t weight_offset = config.weights(l) - genes;
+            const double *raw = config.weights(l);
+
+            for (uint32_t n = 0; n < nodes; n++) {
+                double a = w._a[l][n];
+                w._delta[l][n] = upstream[n] * surrogate_derivative(type, w._z[l][n], a);
+                if (type == ACTIVATION_THRESHOLD) {
+                    w._gradient[threshold_offset + n] -= upstream[n] * a * (1 - a) / _start_temperature;
+                }
+            }
+
+            for (uint32_t n = 0; n < nodes; n++) {
+                double delta = w._delta[l][n];
+                if (delta == 0) continue;
+                uint32_t i = n * inputs;
+                for (uint32_t s = 0; s < l; s++) {
+                    if (!(sources & layer_bit(s))) continue;
+                    const std::vector<double> &a = w._a[s];
+                    std::vector<double> &next = w._upstream[s];
+                    for (uint32_t k = 0; k < a.size(); k++, i++) {
+                        double q = 1 + std::abs(raw[i]);
+                        w._gradient[weight_offset + i] += delta * a[k] / (q * q);
+                        next[k] += delta * _effective[l][i];
+                    }
+                }
+            }
+        }
+    }
+
+    neural_pool                        &_pool;
+    structure_config                   &_config;
+    double                              _learning_rate = 0;
+    uint32_t                            _batch_size = 0;
+    double                              _temperature = 0;
+    double                              _start_temperature = 0;
+    double                              _final_temperature = 0;
+    uint32_t                            _anneal_epochs = 0;
+    uint64_t                            _anneal_begin = 0;  // _epoch when the schedule started
+    double                              _momentum = 0;
+    uint64_t                            _epoch = 0;
+    std::vector<double>                 _velocity;      // laid out like structure_config::genes()
+    std::vector<uint32_t>               _shape;         // per layer: node count, input count, as _velocity and _effective were sized
+    std::vector<std::vector<double> >   _effective;     // index: layer, node * inputs + input
+    std::vector<worker_state>           _workers;       // index: worker
+};
+
+}
@@ -0,0 +1,349 @@
+#pragma once
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "neural_structure.h"
+#include "model_file.h"
+
+namespace nn {
+
+// Wire format, native endian, over a SOCK_STREAM Unix domain socket.
+// Request:  inference_request_header, then _input_count doubles.
+// Response: inference_response_header, then _output_count doubles.
+// A request for an unknown model, or with an input count other than the
+// model's, closes the connection without a reply.
+struct inference_request_header {
+    uint32_t _model = 0;
+    uint32_t _input_count = 0;
+};
+
+struct inference_response_header {
+    uint32_t _status = 0;
+    uint32_t _output_count = 0;
+};
+
+enum inference_status {
+    INFERENCE_OK = 0,
+    INFERENCE_BAD_MODEL,
+    INFERENCE_BAD_INPUT
+};
+
+inline bool read_fully(int fd, void *buffer, size_t length) {
+    char *p = (char *)buffer;
+    while (length) {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+inline bool write_fully(int fd, const void *buffer, size_t length) {
+    const char *p = (const char *)buffer;
+    while (length) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        length -= n;
+    }
+    return true;
+}
+
+// nth percentile of samples; sorts in place.
+inline uint64_t percentile(std::vector<uint64_t> &samples, double p) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t index = (size_t)(p / 100.0 * (samples.size() - 1) + .5);
+    return samples[index];
+}
+
+// Serves evolved networks over a Unix domain socket.
+//
+// One reader thread per connection parses requests into a shared queue. A
+// single batcher thread waits until either max_batch requests are queued or
+// the oldest one has waited latency_budget, then evaluates the whole batch
+// grouped by model, so each network's weights stay hot in cache across
+// consecutive requests, and writes the replies. Latency is measured from a
+// request being fully read to its reply being written.
+class inference_server {
+
+public:
+    inference_server(std::mt19937 &gen,
+                     uint32_t latency_budget_us = 200,
+                     uint32_t max_batch = 64)
+        : _gen(gen),
+          _latency_budget(latency_budget_us),
+          _max_batch(max_batch) {}
+
+    void add_model(const structure_config &config) {
+        model m;
+        m._structure = new neural_structure(_gen, config);
+        m._structure->init();
+        m._structure->set_team(_team);
+        _models.push_back(m);
+    }
+
+    // Serve a network of a mapped model_file in place. The file must stay
+    // open while the server runs.
+    void add_model(const mapped_network &network) {
+        model m;
+        m._mapped = network;
+        _models.push_back(m);
+        _scratch.resize(std::max<size_t>(_scratch.size(), network.scratch_size()));
+    }
+
+    // Split wide models' layers across team. Only the batcher thread
+    // computes, so one team serves every model. Mapped models run serially.
+    void set_team(thread_team *team) {
+        _team = team;
+        for (auto &m : _models) {
+            if (m._structure) m._structure->set_team(team);
+        }
+    }
+
+    uint32_t model_count() { return _models.size(); }
+
+    // Accept connections on path until stop() is called. Prints latency
+    // percentiles every report_interval_ms.
+    bool serve(const char *path, uint32_t report_interval_ms = 1000) {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            printf("inference_server: socket failed\n");
+            return false;
+        }
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        unlink(path);
+        if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 128) < 0) {
+            printf("inference_server: unable to listen on %s\n", path);
+            close(listener);
+            return false;
+        }
+
+        std::thread batcher(&inference_server::batcher_thread, this);
+        std::chrono::steady_clock::time_point last_report = std::chrono::steady_clock::now();
+        while (!_stop) {
+            pollfd p = { listener, POLLIN, 0 };
+            if (poll(&p, 1, 100) > 0) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    std::shared_ptr<connection> c(new connection(fd));
+                    std::lock_guard<std::mutex> lock(_connection_lock);
+                    _connections.erase(std::remove_if(_connections.begin(), _connections.end(),
+                        [](const std::weak_ptr<connection> &w) { return w.expired(); }), _connections.end());
+                    _connections.push_back(c);
+                    _active_readers++;
+                    std::thread(&inference_server::reader_thread, this, c).detach();
+                }
+            }
+            if (std::chrono::steady_clock::now() - last_report > std::chrono::milliseconds(report_interval_ms)) {
+                report();
+                last_report = std::chrono::steady_clock::now();
+            }
+        }
+
+        close(listener);
+        unlink(path);
+        {
+            std::unique_lock<std::mutex> lock(_connection_lock);
+            for (auto &w : _connections) {
+                std::shared_ptr<connection> c = w.lock();
+                if (c) shutdown(c->_fd, SHUT_RDWR);
+            }
+            _readers_cv.wait(lock, [this] { return _active_readers == 0; });
+        }
+        stop();
+        batcher.join();
+        report();
+        return true;
+    }
+
+    void stop() {
+        _stop = true;
+        std::lock_guard<std::mutex> lock(_queue_lock);
+        _queue_cv.notify_all();
+    }
+
+    // stop() for signal handlers: only sets the flag, which serve() checks
+    // at least every 100ms before waking the other threads itself.
+    void request_stop() { _stop.store(true); }
+
+    // Print and reset latency percentiles for the requests served so far.
+    void report() {
+        std::vector<uint64_t> samples;
+        uint64_t batches = 0;
+        {
+            std::lock_guard<std::mutex> lock(_stats_lock);
+            samples.swap(_latencies);
+            batches = _batches;
+            _batches = 0;
+        }
+        if (samples.empty()) return;
+        uint64_t count = samples.size();
+        uint64_t p50 = percentile(samples, 50);
+        uint64_t p99 = percentile(samples, 99);
+        printf("served %lu requests in %lu batches: p50 %.1fus p99 %.1fus\n",
+               (unsigned long)count, (unsigned long)batches, p50 / 1000.0, p99 / 1000.0);
+    }
+
+    ~inference_server() {
+        for (auto &m : _models) delete m._structure;
+    }
+
+private:
+    // Built from a genome, or mapped from a model_file.
+    struct model {
+        neural_structure   *_structure = nullptr;
+        mapped_network      _mapped;
+
+        uint32_t input_count() {
+            return _structure ? _structure->get_input_layer()->node_count() : _mapped.input_count();
+        }
+    };
+
+    struct connection {
+        connection(int fd) : _fd(fd) {}
+        ~connection() { close(_fd); }
+        int _fd;
+    };
+
+    struct request {
+        std::shared_ptr<connection>             _connection;
+        uint32_t                                _model = 0;
+        std::vector<double>                     _inputs;
+        std::chrono::steady_clock::time_point   _arrival;
+    };
+
+    void reader_thread(std::shared_ptr<connection> c) {
+        while (!_stop) {
+            inference_request_header header;
+            if (!read_fully(c->_fd, &header, sizeof(header))) break;
+            // The count comes from the client: never size a buffer from one
+            // that does not match the model. The stream cannot be resynced
+            // past an unknown body, so the connection is dropped.
+            if (header._model >= _models.size() ||
+                header._input_count != _models[header._model].input_count()) {
+                break;
+            }
+            request r;
+            r._connection = c;
+            r._model = header._model;
+            r._inputs.resize(header._input_count);
+            if (!read_fully(c->_fd, r._inputs.data(), r._inputs.size() * sizeof(double))) break;
+            r._arrival = std::chrono::steady_clock::now();
+
+            std::lock_guard<std::mutex> lock(_queue_lock);
+            _queue.push_back(std::move(r));
+            if (_queue.size() == 1 || _queue.size() >= _max_batch) _queue_cv.notify_all();
+        }
+        c.reset();
+        std::lock_guard<std::mutex> lock(_connection_lock);
+        _active_readers--;
+        _readers_cv.notify_all();
+    }
+
+    void batcher_thread() {
+        std::vector<request> batch;
+        std::unique_lock<std::mutex> lock(_queue_lock);
+        while (true) {
+            _queue_cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+            if (_stop) return;
+            std::chrono::steady_clock::time_point deadline = _queue.front()._arrival + _latency_budget;
+            _queue_cv.wait_until(lock, deadline, [this] { return _stop || _queue.size() >= _max_batch; });
+            if (_stop) return;
+
+            uint32_t count = std::min<size_t>(_queue.size(), _max_batch);
+            batch.clear();
+            for (uint32_t i = 0; i < count; i++) {
+                batch.push_back(std::move(_queue.front()));
+                _queue.pop_front();
+            }
+            lock.unlock();
+            evaluate(batch);
+            lock.lock();
+        }
+    }
+
+    void evaluate(std::vector<request> &batch) {
+        std::stable_sort(batch.begin(), batch.end(), [](const request &a, const request &b) {
+            return a._model < b._model;
+        });
+
+        std::vector<uint64_t> latencies;
+        std::vector<double> outputs;
+        for (auto &r : batch) {
+            inference_response_header header;
+            outputs.clear();
+            if (r._model >= _models.size()) {
+                header._status = INFERENCE_BAD_MODEL;
+            }
+            else if (r._inputs.size() != _models[r._model].input_count()) {
+                header._status = INFERENCE_BAD_INPUT;
+            }
+            else if (_models[r._model]._structure) {
+                neural_structure *s = _models[r._model]._structure;
+                s->fill_input_neurons(r._inputs);
+                s->compute_network();
+                for (auto &n : s->get_output_layer()->get_nodes()) {
+                    outputs.push_back(n->value());
+                }
+            }
+            else {
+                const mapped_network &m = _models[r._model]._mapped;
+                const double *values = m.compute(r._inputs.data(), _scratch.data());
+                outputs.assign(values, values + m.output_count());
+            }
+            header._output_count = outputs.size();
+            if (write_fully(r._connection->_fd, &header, sizeof(header))) {
+                write_fully(r._connection->_fd, outputs.data(), outputs.size() * sizeof(double));
+            }
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - r._arrival).count());
+        }
+
+        std::lock_guard<std::mutex> lock(_stats_lock);
+        _latencies.insert(_latencies.end(), latencies.begin(), latencies.end());
+        _batches++;
+    }
+
+    std::mt19937                               &_gen;
+    std::chrono::microseconds                   _latency_budget;
+    uint32_t                                    _max_batch = 0;
+    std::atomic<bool>                           _stop{false};   // lock free, so request_stop() is signal safe
+    std::vector<model>                          _models;
+    std::vector<double>                         _scratch;   // for mapped models, batcher thread only
+    thread_team                                *_team = nullptr;
+
+    std::mutex                                  _queue_lock;
+    std::condition_variable                     _queue_cv;
+    std::deque<request>                         _queue;
+
+    std::mutex                                  _connection_lock;
+    std::condition_variable                     _readers_cv;
+    std::vector<std::weak_ptr<connection> >     _connections;
+    uint32_t                                    _active_readers = 0;
+
+    std::mutex                                  _stats_lock;
+    std::vector<uint64_t>                       _latencies;
+    uint64_t                                    _batches = 0;
+};
+
+}
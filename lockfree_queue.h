@@ -0,0 +1,80 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace nn {
+
+// Bounded lock-free queue for any number of producers and consumers
+// (Vyukov's array queue). Each slot carries a sequence number telling whose
+// turn it is, so a push or pop is one compare-and-swap on a shared index
+// plus a release store on the slot; nobody ever waits on a lock. push()
+// fails when the queue is full and pop() when it is empty.
+template <typename T>
+class lockfree_queue {
+
+public:
+    // capacity is rounded up to a power of two.
+    lockfree_queue(uint32_t capacity)
+        : _slots(round_up(capacity)),
+          _mask(_slots.size() - 1) {
+        for (uint32_t i = 0; i < _slots.size(); i++) _slots[i]._sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const T &value) {
+        uint64_t position = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            slot &s = _slots[position & _mask];
+            int64_t turn = (int64_t)s._sequence.load(std::memory_order_acquire) - (int64_t)position;
+            if (turn < 0) return false;
+            if (turn > 0) {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+            else if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                s._value = value;
+                s._sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    bool pop(T &value) {
+        uint64_t position = _head.load(std::memory_order_relaxed);
+        while (true) {
+            slot &s = _slots[position & _mask];
+            int64_t turn = (int64_t)s._sequence.load(std::memory_order_acquire) - (int64_t)(position + 1);
+            if (turn < 0) return false;
+            if (turn > 0) {
+                position = _head.load(std::memory_order_relaxed);
+            }
+            else if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                value = s._value;
+                s._sequence.store(position + _mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+private:
+    lockfree_queue(const lockfree_queue &) = delete;
+    lockfree_queue &operator=(const lockfree_queue &) = delete;
+
+    struct slot {
+        std::atomic<uint64_t>   _sequence{0};
+        T                       _value = T();
+    };
+
+    static uint32_t round_up(uint32_t capacity) {
+        uint32_t size = 2;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    std::vector<slot>       _slots;
+    uint64_t                _mask = 0;
+    // Producers and consumers contend on different lines.
+    alignas(64) std::atomic<uint64_t>   _tail{0};
+    alignas(64) std::atomic<uint64_t>   _head{0};
+};
+
+}
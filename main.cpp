@@ -1,11 +1,17 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <vector>
 #include "neural_pool.h"
 #include "fitness.h"
+#include "speciation.h"
 
-int main() {
+int main(int argc, char **argv) {
     printf("Starting Neural Net.\n");
     nn::neural_pool pool(10);
+    if (argc > 1) {
+        // Reproducible run for benchmarking: ./nn.exe <seed>
+        pool.set_seed(strtoull(argv[1], nullptr, 10));
+    }
 
     std::vector<double> inputs;
     inputs.push_back(0.04);
@@ -14,6 +20,8 @@ int main() {
     inputs.push_back(0.91);
     inputs.push_back(0.25);
 
+    // Only two inputs change between the two computes below.
+    pool.set_incremental(true);
     pool.init();
     pool.feed_inputs(inputs);
     //pool.enumerate_pool();
@@ -30,8 +38,13 @@ int main() {
 
     //pool.enumerate_pool();
 
+    nn::speciation species;
+    species.speciate(pool.get_structures());
+    printf("%u species\n", species.species_count());
+
     nn::fitness_measure fitness(pool);
-    fitness.evaluate_fitness();
+    fitness.evaluate_fitness(nn::search_budget::seconds(10));
+    fitness.evaluate_fitness_pipelined(nn::search_budget::seconds(10));
     
     printf("Complete\n");
     return 0;
@@ -0,0 +1,329 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "neural_map.h"
+#include "neural_simd.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace nn {
+
+// Read-only file of compiled networks for serving, laid out the way they
+// are evaluated so a mapped file is used in place: no parsing, no
+// allocation, and processes serving the same file share its pages through
+// the page cache. Multi-byte fields are native endian.
+//
+//   model_file_header | model offsets | per model: model_header | model_layer table | arrays
+//
+// Every array starts on a 64 byte boundary. Weights are stored already
+// squashed by softsign, row-major by node with one column per node of each
+// source layer, as neural_layer keeps them, so results match
+// neural_structure::compute_network() exactly.
+const uint32_t MODEL_FILE_VERSION = 1;
+const uint32_t MODEL_FILE_ALIGNMENT = 64;
+
+struct model_file_header {
+    char        _magic[8] = { 'N', 'N', 'M', 'O', 'D', 'E', 'L', 0 };
+    uint32_t    _version = MODEL_FILE_VERSION;
+    uint32_t    _model_count = 0;
+    uint64_t    _length = 0;        // bytes in the whole file
+};
+
+struct model_header {
+    uint32_t    _layer_count = 0;
+    uint32_t    _value_count = 0;   // scratch doubles compute() needs
+    uint64_t    _layers = 0;        // file offset of the model_layer table
+};
+
+struct model_layer {
+    uint32_t    _node_count = 0;
+    uint32_t    _input_count = 0;
+    uint32_t    _activation = ACTIVATION_THRESHOLD;
+    uint32_t    _value_offset = 0;  // doubles into the scratch; unused for layer 0
+    uint64_t    _sources = 0;       // as structure_config::sources()
+    uint64_t    _thresholds = 0;    // file offset
+    uint64_t    _weights = 0;       // file offset
+};
+
+// One network of a mapped model_file. A plain view, cheap to copy, valid
+// while the file stays open.
+class mapped_network {
+
+public:
+    mapped_network() {}
+
+    mapped_network(const char *base, const model_header *header)
+        : _base(base),
+          _header(header),
+          _layers((const model_layer *)(base + header->_layers)) {}
+
+    uint32_t input_count() const { return _layers[0]._node_count; }
+
+    uint32_t output_count() const { return _layers[_header->_layer_count - 1]._node_count; }
+
+    // Doubles of scratch compute() needs.
+    uint32_t scratch_size() const { return _header->_value_count; }
+
+    // Evaluate on inputs, read in place. Every non-input layer's values go
+    // to the caller's scratch; returns the output layer's, within it.
+    const double *compute(const double *inputs, double *scratch) const {
+        uint32_t layer_count = _header->_layer_count;
+        for (uint32_t l = 1; l < layer_count; l++) {
+            const model_layer &layer = _layers[l];
+            const double *weights = (const double *)(_base + layer._weights);
+            double *values = scratch + layer._value_offset;
+            for (uint32_t n = 0; n < layer._node_count; n++) {
+                const double *row = weights + (uint64_t)n * layer._input_count;
+                double sum = 0;
+                for (uint32_t s = 0; s < l; s++) {
+                    if (!(layer._sources & layer_bit(s))) continue;
+                    const double *source = s ? scratch + _layers[s]._value_offset : inputs;
+                    sum += simd::dot(row, source, _layers[s]._node_count);
+                    row += _layers[s]._node_count;
+                }
+                values[n] = sum;
+            }
+            activate_layer((activation_type)layer._activation, values,
+                           (const double *)(_base + layer._thresholds), layer._node_count);
+        }
+        return scratch + _layers[layer_count - 1]._value_offset;
+    }
+
+private:
+    const char             *_base = nullptr;
+    const model_header     *_header = nullptr;
+    const model_layer      *_layers = nullptr;
+};
+
+class model_file {
+
+public:
+    model_file() {}
+
+    // Compile configs into a model file at path.
+    static bool write(const char *path, const std::vector<structure_config> &configs) {
+        std::vector<char> file;
+        model_file_header header;
+        header._model_count = configs.size();
+        append(file, &header, sizeof(header));
+        uint64_t offsets_at = file.size();
+        file.resize(file.size() + configs.size() * sizeof(uint64_t));
+
+        for (uint32_t m = 0; m < configs.size(); m++) {
+            const structure_config &config = configs[m];
+            uint32_t layer_count = config.get_layer_count();
+            align(file);
+            uint64_t model_at = file.size();
+            memcpy(&file[offsets_at + m * sizeof(uint64_t)], &model_at, sizeof(model_at));
+
+            model_header model;
+            model._layer_count = layer_count;
+            model._layers = model_at + sizeof(model);
+            std::vector<model_layer> layers(layer_count);
+            for (uint32_t l = 0; l < layer_count; l++) {
+                layers[l]._node_count = config.node_count(l);
+                layers[l]._input_count = config.input_count(l);
+                layers[l]._activation = config.activation(l);
+                layers[l]._sources = config.sources(l);
+                if (!l) continue;
+                // Keep every layer's values on their own cache lines.
+                layers[l]._value_offset = model._value_count;
+                model._value_count += (config.node_count(l) + 7) & ~7u;
+            }
+            append(file, &model, sizeof(model));
+            append(file, layers.data(), layers.size() * sizeof(model_layer));
+
+            for (uint32_t l = 0; l < layer_count; l++) {
+                uint32_t nodes = config.node_count(l);
+                uint32_t inputs = config.input_count(l);
+                align(file);
+                layers[l]._thresholds = file.size();
+                append(file, config.thresholds(l), nodes * sizeof(double));
+                align(file);
+                layers[l]._weights = file.size();
+                std::vector<double> weights(config.weights(l), config.weights(l) + (uint64_t)nodes * inputs);
+                for (auto &w : weights) w = softsign(w);
+                append(file, weights.data(), weights.size() * sizeof(double));
+            }
+            memcpy(&file[model._layers], layers.data(), layers.size() * sizeof(model_layer));
+        }
+        header._length = file.size();
+        memcpy(&file[0], &header, sizeof(header));
+
+        FILE *f = fopen(path, "wb");
+        if (!f) {
+            printf("model_file: unable to create %s\n", path);
+            return false;
+        }
+        bool ok = fwrite(file.data(), 1, file.size(), f) == file.size();
+        ok = fclose(f) == 0 && ok;
+        if (!ok) printf("model_file: write to %s failed\n", path);
+        return ok;
+    }
+
+    // Map a model file and check it; false if it is not one or is damaged.
+    bool open(const char *path) {
+        close();
+        _path = path;
+        if (!map()) return false;
+        if (!valid()) {
+            printf("model_file: %s is not a valid model file\n", path);
+            close();
+            return false;
+        }
+        const model_file_header *header = (const model_file_header *)_data;
+        const uint64_t *offsets = (const uint64_t *)(header + 1);
+        for (uint32_t m = 0; m < header->_model_count; m++) {
+            _models.push_back(mapped_network(_data, (const model_header *)(_data + offsets[m])));
+        }
+        return true;
+    }
+
+    // True if path starts like a model file, for telling it from other formats.
+    static bool is_model_file(const char *path) {
+        FILE *f = fopen(path, "rb");
+        if (!f) return false;
+        model_file_header header, expected;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+                  !memcmp(header._magic, expected._magic, sizeof(expected._magic));
+        fclose(f);
+        return ok;
+    }
+
+    uint32_t model_count() { return _models.size(); }
+
+    const mapped_network &model(uint32_t i) { return _models[i]; }
+
+    void close() {
+        unmap();
+        _models.clear();
+    }
+
+    ~model_file() { close(); }
+
+private:
+    model_file(const model_file &) = delete;
+    model_file &operator=(const model_file &) = delete;
+
+    static void append(std::vector<char> &file, const void *data, uint64_t bytes) {
+        file.insert(file.end(), (const char *)data, (const char *)data + bytes);
+    }
+
+    static void align(std::vector<char> &file) {
+        file.resize((file.size() + MODEL_FILE_ALIGNMENT - 1) & ~(uint64_t)(MODEL_FILE_ALIGNMENT - 1), 0);
+    }
+
+    // Everything compute() will touch lies inside the file and adds up.
+    bool valid() {
+        model_file_header expected;
+        const model_file_header *header = (const model_file_header *)_data;
+        if (_length < sizeof(*header) || memcmp(header->_magic, expected._magic, sizeof(expected._magic)) ||
+            header->_version != MODEL_FILE_VERSION || header->_length != _length ||
+            (_length - sizeof(*header)) / sizeof(uint64_t) < header->_model_count) {
+            return false;
+        }
+        const uint64_t *offsets = (const uint64_t *)(header + 1);
+        for (uint32_t m = 0; m < header->_model_count; m++) {
+            if (!inside(offsets[m], sizeof(model_header))) return false;
+            const model_header *model = (const model_header *)(_data + offsets[m]);
+            uint32_t layer_count = model->_layer_count;
+            if (layer_count < 2 || layer_count > MAX_LAYER_COUNT ||
+                !inside(model->_layers, layer_count * sizeof(model_layer))) {
+                return false;
+            }
+            const model_layer *layers = (const model_layer *)(_data + model->_layers);
+            if (layers[0]._sources) return false;
+            for (uint32_t l = 1; l < layer_count; l++) {
+                const model_layer &layer = layers[l];
+                uint64_t inputs = 0;
+                for (uint32_t s = 0; s < l; s++) {
+                    if (layer._sources & layer_bit(s)) inputs += layers[s]._node_count;
+                }
+                if (!layer._sources || layer._sources >> l || inputs != layer._input_count ||
+                    layer._activation >= ACTIVATION_COUNT ||
+                    (uint64_t)layer._value_offset + layer._node_count > model->_value_count ||
+                    !inside(layer._thresholds, layer._node_count * sizeof(double)) ||
+                    !inside(layer._weights, (uint64_t)layer._node_count * inputs * sizeof(double))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool inside(uint64_t offset, uint64_t bytes) {
+        return offset % sizeof(double) == 0 && offset <= _length && bytes <= _length - offset;
+    }
+
+#ifdef __linux__
+    bool map() {
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            printf("model_file: unable to open %s\n", _path.c_str());
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        _length = st.st_size;
+        if (_length) {
+            void *data = mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                printf("model_file: unable to map %s\n", _path.c_str());
+                ::close(fd);
+                return false;
+            }
+            // Requests hit models in any order; start paging everything in.
+            madvise(data, _length, MADV_WILLNEED);
+            _data = (const char *)data;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    void unmap() {
+        if (_data) munmap((void *)_data, _length);
+        _data = nullptr;
+        _length = 0;
+    }
+#else
+    // Read into an aligned buffer where mmap is not available.
+    bool map() {
+        FILE *f = fopen(_path.c_str(), "rb");
+        if (!f) {
+            printf("model_file: unable to open %s\n", _path.c_str());
+            return false;
+        }
+        fseek(f, 0, SEEK_END);
+        _length = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        _buffer.resize(_length / sizeof(double) + MODEL_FILE_ALIGNMENT / sizeof(double) + 1);
+        char *data = (char *)(((uintptr_t)_buffer.data() + MODEL_FILE_ALIGNMENT - 1) & ~(uintptr_t)(MODEL_FILE_ALIGNMENT - 1));
+        bool ok = fread(data, 1, _length, f) == _length;
+        fclose(f);
+        _data = data;
+        return ok;
+    }
+
+    void unmap() {
+        _buffer.clear();
+        _data = nullptr;
+        _length = 0;
+    }
+
+    std::vector<double>             _buffer;
+#endif
+
+    std::string                     _path;
+    const char                     *_data = nullptr;
+    uint64_t                        _length = 0;
+    std::vector<mapped_network>     _models;
+};
+
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "neural_map.h"
+
+#ifndef __linux__
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
+#endif
+
+namespace nn {
+
+// Fixed part of every journal entry; followed by _draw_count doubles.
+struct journal_entry_header {
+    uint64_t    _generation = 0;    // neural_pool::epoch()
+    uint32_t    _candidate = 0;
+    uint32_t    _op = 0;
+    uint32_t    _draw_count = 0;
+    uint32_t    _reserved = 0;      // keeps the draws double aligned
+};
+static_assert(sizeof(journal_entry_header) % sizeof(double) == 0, "entries must stay double aligned");
+
+// _op of an entry that replaces a candidate with a copy of another, taken
+// as the generation started; its one draw is that parent's index.
+const uint32_t JOURNAL_COPY_PARENT = 0xffffffffu;
+
+// Append-only binary log of every mutation applied to a population.
+//
+// Each entry is one mutation_record tagged with the generation and candidate
+// it was applied to, typically 24 bytes plus four doubles for a point
+// mutation, against the whole genome a snapshot would write. log() only
+// encodes into a memory buffer; a background thread writes the buffer out,
+// so the evolution loop never waits on the disk. Together with a genome_store
+// snapshot of generation s, replay() rebuilds any later generation.
+class mutation_journal {
+
+public:
+    mutation_journal() {}
+
+    // Start a new journal, or continue an existing one after a restart.
+    bool open(const char *path, bool append = false) {
+        close();
+        _path = path;
+        _file = fopen(path, append ? "ab" : "wb");
+        if (!_file) {
+            printf("mutation_journal: unable to open %s\n", path);
+            return false;
+        }
+        _closing = false;
+        _failed = false;
+        _logged = 0;
+        _written = 0;
+        _writer = std::thread(&mutation_journal::writer_thread, this);
+        return true;
+    }
+
+    // Queue the mutations applied to candidate in this generation.
+    void log(uint64_t generation, uint32_t candidate, const std::vector<mutation_record> &records) {
+        assert(_file);
+        std::lock_guard<std::mutex> lock(_lock);
+        for (auto &record : records) {
+            append_entry(generation, candidate, record._op, record._draws.data(), record._draws.size());
+        }
+        _wake_cv.notify_one();
+    }
+
+    // Queue that candidate starts this generation as a copy of parent, before
+    // any mutations logged for it.
+    void log_parent(uint64_t generation, uint32_t candidate, uint32_t parent) {
+        assert(_file);
+        double draw = parent;
+        std::lock_guard<std::mutex> lock(_lock);
+        append_entry(generation, candidate, JOURNAL_COPY_PARENT, &draw, 1);
+        _wake_cv.notify_one();
+    }
+
+    // Wait until everything logged so far has been handed to the OS.
+    // Returns false if any write failed.
+    bool flush() {
+        std::unique_lock<std::mutex> lock(_lock);
+        _written_cv.wait(lock, [this] { return _written == _logged || _failed; });
+        return !_failed;
+    }
+
+    uint64_t bytes() {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _logged;
+    }
+
+    bool close() {
+        if (!_file) return true;
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _closing = true;
+            _wake_cv.notify_one();
+        }
+        _writer.join();
+        bool ok = fclose(_file) == 0 && !_failed;
+        _file = nullptr;
+        return ok;
+    }
+
+    ~mutation_journal() { close(); }
+
+    // Apply every entry of the journal at path whose generation is in
+    // [first, last) to population, indexed by candidate. population must
+    // hold generation `first`, e.g. loaded from a snapshot taken then. A
+    // torn entry at the end, left by a crash mid-write, is ignored. Parent
+    // copies read the population as their generation started, so offspring
+    // may come from candidates already replaced.
+    static bool replay(const char *path, uint64_t first, uint64_t last,
+                       std::vector<structure_config> &population) {
+        FILE *f = fopen(path, "rb");
+        if (!f) {
+            printf("mutation_journal: unable to open %s\n", path);
+            return false;
+        }
+        bool ok = true;
+        journal_entry_header header;
+        mutation_record record;
+        std::vector<structure_config> parents;          // population as parents_generation started
+        uint64_t parents_generation = UINT64_MAX;
+        while (fread(&header, sizeof(header), 1, f) == 1) {
+            record._draws.resize(header._draw_count);
+            if (fread(record._draws.data(), sizeof(double), header._draw_count, f) != header._draw_count) {
+                printf("mutation_journal: ignoring torn entry at the end of %s\n", path);
+                break;
+            }
+            if (header._generation < first || header._generation >= last) continue;
+            if (header._op == JOURNAL_COPY_PARENT && header._candidate < population.size() &&
+                header._draw_count == 1 && record._draws[0] < population.size()) {
+                if (parents_generation != header._generation) {
+                    parents = population;
+                    parents_generation = header._generation;
+                }
+                population[header._candidate] = parents[(uint32_t)record._draws[0]];
+                continue;
+            }
+            if (header._candidate >= population.size() || header._op >= MUTATE_OP_COUNT) {
+                printf("mutation_journal: bad entry in %s\n", path);
+                ok = false;
+                break;
+            }
+            record._op = (mutation_op)header._op;
+            population[header._candidate].replay(record);
+        }
+        fclose(f);
+        return ok;
+    }
+
+private:
+    mutation_journal(const mutation_journal &) = delete;
+    mutation_journal &operator=(const mutation_journal &) = delete;
+
+    // With _lock held.
+    void append_entry(uint64_t generation, uint32_t candidate, uint32_t op, const double *draws, uint32_t count) {
+        journal_entry_header header;
+        header._generation = generation;
+        header._candidate = candidate;
+        header._op = op;
+        header._draw_count = count;
+        append(&header, sizeof(header));
+        append(draws, count * sizeof(double));
+        _logged += sizeof(header) + count * sizeof(double);
+    }
+
+    void append(const void *data, size_t size) {
+        const char *bytes = (const char *)data;
+        _pending.insert(_pending.end(), bytes, bytes + size);
+    }
+
+    // Swap the pending buffer out and write it without holding the lock,
+    // so log() only ever waits for a buffer swap.
+    void writer_thread() {
+        std::vector<char> buffer;
+        std::unique_lock<std::mutex> lock(_lock);
+        while (true) {
+            _wake_cv.wait(lock, [this] { return !_pending.empty() || _closing; });
+            if (_pending.empty()) return;
+            buffer.swap(_pending);
+            lock.unlock();
+
+            bool ok = fwrite(buffer.data(), 1, buffer.size(), _file) == buffer.size() && fflush(_file) == 0;
+            uint64_t size = buffer.size();
+            buffer.clear();
+
+            lock.lock();
+            if (!ok && !_failed) {
+                printf("mutation_journal: write to %s failed\n", _path.c_str());
+                _failed = true;
+            }
+            _written += size;
+            _written_cv.notify_all();
+        }
+    }
+
+    std::string             _path;
+    FILE                   *_file = nullptr;
+    std::thread             _writer;
+    std::mutex              _lock;
+    std::condition_variable _wake_cv;
+    std::condition_variable _written_cv;
+    std::vector<char>       _pending;       // encoded entries not yet taken by the writer
+    uint64_t                _logged = 0;    // bytes
+    uint64_t                _written = 0;   // bytes
+    bool                    _closing = false;
+    bool                    _failed = false;
+};
+
+}
@@ -1,16 +1,31 @@
 #pragma once
 #include <stdio.h>
+#include <assert.h>
 #include <random>
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <cstdint>
+#include <algorithm>
+#include "activation.h"
 
 namespace nn {
 
+// Stateless 64 bit mixer, used to derive independent random streams.
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
 struct mutation_chart {
     uint32_t del_layer      = 100;
-    uint32_t zero_conn      = 98;
-    uint32_t add_layer      = 95;
-    uint32_t del_node       = 90;
+    uint32_t del_skip       = 98;
+    uint32_t add_skip       = 97;
+    uint32_t zero_conn      = 96;
+    uint32_t add_layer      = 93;
+    uint32_t del_node       = 89;
     uint32_t invert_conn    = 85;
     uint32_t add_node       = 80;
     uint32_t mut_strength   = 70;
@@ -19,16 +34,74 @@ struct mutation_chart {
     uint32_t nothing        = 15;
 };
 
+// Mutation operators, as recorded in a mutation_record.
+enum mutation_op {
+    MUTATE_THRESHOLD = 0,
+    MUTATE_WEIGHT,
+    MUTATE_STRENGTH,
+    MUTATE_ADD_NODE,
+    MUTATE_INVERT_CONNECTION,
+    MUTATE_DELETE_NODE,
+    MUTATE_ADD_LAYER,
+    MUTATE_ZERO_CONNECTION,
+    MUTATE_DELETE_LAYER,
+    MUTATE_ADD_SKIP,
+    MUTATE_DELETE_SKIP,
+    MUTATE_OP_COUNT
+};
+
+// One applied mutation operator and every random value it drew, in draw
+// order: the location it picked first, then any new gene values. Replaying
+// it reproduces the mutation exactly without the generator.
+struct mutation_record {
+    mutation_op         _op = MUTATE_THRESHOLD;
+    std::vector<double> _draws;
+};
+
+// Genome layout. Everything is stored as doubles so a genome is one flat
+// buffer that copies with a memcpy. Copies of a config share the buffer
+// until one of them writes to it:
+//   header | layer sizes | layer activations | layer sources | layer 0 genes | layer 1 genes | ...
+// A layer's sources are a bit mask of the earlier layers it reads; by
+// default just the one before it, and layer 0 reads none. Each layer's genes
+// are its node thresholds followed by its connection weights, row-major by
+// node: one row per node, one column per node of each source, sources in
+// layer order.
+enum genome_header {
+    GENOME_LAYER_COUNT = 0,
+    GENOME_INPUT_COUNT,
+    GENOME_OUTPUT_COUNT,
+    GENOME_HEADER_SIZE
+};
+
+// Source masks must stay exact as doubles.
+const uint32_t MAX_LAYER_COUNT = 53;
+
+inline uint64_t layer_bit(uint32_t layer) { return 1ull << layer; }
+
+// Views into a structure_config genome, valid until its shape next changes.
 struct node_config {
+    activation_type _activation = ACTIVATION_THRESHOLD;
     double _activation_threshold = 0;
-    std::vector<double> _connection_weights;
+    const double *_connection_weights = nullptr;
 };
 
 struct layer_config {
     uint32_t _node_count = 0;
-
-    // index: node, value: node config
-    std::vector<node_config> _node_configs;
+    uint32_t _input_count = 0;
+    uint64_t _sources = 0;
+    activation_type _activation = ACTIVATION_THRESHOLD;
+    const double *_thresholds = nullptr;
+    const double *_weights = nullptr;
+    uint64_t _id = 0;       // structure_config::layer_id()
+
+    node_config node(uint32_t i) const {
+        node_config n;
+        n._activation = _activation;
+        n._activation_threshold = _thresholds[i];
+        n._connection_weights = _weights + i * _input_count;
+        return n;
+    }
 };
 
 class structure_config {
@@ -43,43 +116,79 @@ public:
       _node_count_distribution(5, max_node_count),
       _threshold_distribution(min_threshold, 1),
       _weight_distribution(0, 1),
-      _negative_selector(-1, 1) {}
+      _negative_selector(-1, 1),
+      _genome(std::make_shared<std::vector<double>>(GENOME_HEADER_SIZE, 0)) {}
+
+    structure_config(const structure_config &other) = default;
+
+    // _gen is shared by every config in a pool, so it stays bound.
+    structure_config &operator=(const structure_config &other) {
+        _mutate_attribute_distribution  = other._mutate_attribute_distribution;
+        _layer_count_distribution       = other._layer_count_distribution;
+        _node_count_distribution        = other._node_count_distribution;
+        _threshold_distribution         = other._threshold_distribution;
+        _weight_distribution            = other._weight_distribution;
+        _negative_selector              = other._negative_selector;
+        _mutation_chart                 = other._mutation_chart;
+        _default_activation             = other._default_activation;
+        _genome                         = other._genome;
+        _offsets                        = other._offsets;
+        _layer_ids                      = other._layer_ids;
+        return *this;
+    }
 
     void random() {
-        _layer_count = _layer_count_distribution(_gen);
-        uint32_t prev_layer_count = 0;
-        uint32_t output_layer_index = _layer_count - 1;
-        uint32_t count = 0;
-        for (uint32_t i = 0; i < _layer_count; i++) {
-            _layer_configs.push_back(layer_config());
-            if (i == 0)                         count = _input_neuron_count;
-            else if (i == output_layer_index)   count = _output_neuron_count;
+        uint32_t layer_count = _layer_count_distribution(_gen);
+        uint32_t output_layer_index = layer_count - 1;
+        std::vector<double> &genome = writable_genome();
+        genome.resize(GENOME_HEADER_SIZE);
+        genome[GENOME_LAYER_COUNT] = layer_count;
+        for (uint32_t i = 0; i < layer_count; i++) {
+            uint32_t count = 0;
+            if (i == 0)                         count = genome[GENOME_INPUT_COUNT];
+            else if (i == output_layer_index)   count = genome[GENOME_OUTPUT_COUNT];
             else                                count = _node_count_distribution(_gen);
-            _layer_configs[i]._node_count = count;
+            genome.push_back(count);
+        }
+        for (uint32_t i = 0; i < layer_count; i++) {
+            genome.push_back(_default_activation);
+        }
+        for (uint32_t i = 0; i < layer_count; i++) {
+            genome.push_back(i ? layer_bit(i - 1) : 0);
+        }
+        for (uint32_t i = 0; i < layer_count; i++) {
+            uint32_t count = node_count(i);
+            uint32_t inputs = input_count(i);
             for (uint32_t j = 0; j < count; j++) {
-                _layer_configs[i]._node_configs.push_back(node_config());
-                _layer_configs[i]._node_configs[j]._activation_threshold = _threshold_distribution(_gen);
-                for (uint32_t l = 0; l < prev_layer_count; l++) {
-                    _layer_configs[i]._node_configs[j]._connection_weights.push_back(_weight_distribution(_gen));
-                }
+                genome.push_back(_threshold_distribution(_gen));
+            }
+            for (uint32_t j = 0; j < count * inputs; j++) {
+                genome.push_back(_weight_distribution(_gen));
             }
-            prev_layer_count = count;
         }
+        update_offsets();
+        _layer_ids.assign(layer_count, 0);
     }
 
-    void describe() {
-        printf("Neural Structure: %d layers.\n", _layer_count);
-        uint32_t layer = 0;
-        for (auto &l : _layer_configs) {
-            uint32_t node = 0;
-            printf("\tLayer %d has %lu nodes\n", layer++, l._node_configs.size());
-            for (auto &n : l._node_configs) {
-                printf("\t\tNode %d: Threshold: %.2f\n", node++, n._activation_threshold);
+    void describe() const {
+        printf("Neural Structure: %d layers.\n", get_layer_count());
+        for (uint32_t layer = 0; layer < get_layer_count(); layer++) {
+            printf("\tLayer %d has %d nodes", layer, node_count(layer));
+            if (layer) {
+                printf(", fed by layers");
+                for (uint32_t s = 0; s < layer; s++) {
+                    if (sources(layer) & layer_bit(s)) printf(" %u", s);
+                }
+            }
+            printf("\n");
+            for (uint32_t node = 0; node < node_count(layer); node++) {
+                printf("\t\tNode %d: Threshold: %.2f\n", node, thresholds(layer)[node]);
             }
         }
     }
 
-    bool mutate(bool allow_reentry = true) {
+    // If applied is given, every operator that runs is appended to it.
+    bool mutate(bool allow_reentry = true, std::vector<mutation_record> *applied = nullptr) {
         uint32_t mutate_attribute = _mutate_attribute_distribution(_gen);
         if (mutate_attribute <= _mutation_chart.nothing) {
             //printf("Mutate nothing.\n");
@@ -87,45 +196,55 @@ public:
         }
         else if (mutate_attribute <= _mutation_chart.mod_thresh) {
             //printf("Mutate a threshold.\n");
-            mutate_threshold();
+            apply_mutation(MUTATE_THRESHOLD, applied);
         }
         if (mutate_attribute <= _mutation_chart.mod_weight) { 
             //printf("Mutate a weight.\n");
-            mutate_weight();
+            apply_mutation(MUTATE_WEIGHT, applied);
         }
         else if (mutate_attribute <= _mutation_chart.mut_strength) {
             //printf("Mutate mutation strength.\n");
-            mutate_mutation_strength();
+            apply_mutation(MUTATE_STRENGTH, applied);
             if (allow_reentry) {
-                return mutate(false);
+                return mutate(false, applied);
             }
             return false;
         }
         else if (mutate_attribute <= _mutation_chart.add_node) {
-            if (_layer_count == 2) return false;
-            mutate_add_node();
+            if (get_layer_count() == 2) return false;
+            apply_mutation(MUTATE_ADD_NODE, applied);
             //printf("Mutate add node.\n");
         }
         else if (mutate_attribute <= _mutation_chart.invert_conn) {
-            mutate_invert_connection();
+            apply_mutation(MUTATE_INVERT_CONNECTION, applied);
             //printf("Mutate zero connection.\n");
         }
         else if (mutate_attribute <= _mutation_chart.del_node) {
-            if (_layer_count == 2) return false;
-            mutate_delete_node();
+            if (get_layer_count() == 2) return false;
+            apply_mutation(MUTATE_DELETE_NODE, applied);
             //printf("Mutate delete node.\n");
         }
         else if (mutate_attribute <= _mutation_chart.add_layer) {
-            mutate_add_layer();
+            apply_mutation(MUTATE_ADD_LAYER, applied);
             //printf("Mutate add layer.\n");
         }
         else if (mutate_attribute <= _mutation_chart.zero_conn) {
-            mutate_zero_connection();
+            apply_mutation(MUTATE_ZERO_CONNECTION, applied);
             //printf("Mutate forward connection.\n");
         }
+        else if (mutate_attribute <= _mutation_chart.add_skip) {
+            if (get_layer_count() == 2) return false;
+            apply_mutation(MUTATE_ADD_SKIP, applied);
+            //printf("Mutate add skip connection.\n");
+        }
+        else if (mutate_attribute <= _mutation_chart.del_skip) {
+            if (get_layer_count() == 2) return false;
+            apply_mutation(MUTATE_DELETE_SKIP, applied);
+            //printf("Mutate delete skip connection.\n");
+        }
         else if (mutate_attribute <= _mutation_chart.del_layer) {
-            if (_layer_count == 2) return false;
-            mutate_delete_layer();
+            if (get_layer_count() == 2) return false;
+            apply_mutation(MUTATE_DELETE_LAYER, applied);
             //printf("Mutate delete layer.\n");
         }
         else {
@@ -135,33 +254,168 @@ public:
         return true;
     }
 
-    uint32_t get_layer_count() { return _layer_count; }
+    // Redo a recorded mutation on the genome it was first applied to.
+    void replay(const mutation_record &record) {
+        _replaying = &record;
+        _replay_position = 0;
+        run_operator(record._op);
+        _replaying = nullptr;
+    }
+
+    uint32_t get_layer_count() const { return genome()[GENOME_LAYER_COUNT]; }
+
+    uint32_t node_count(uint32_t layer) const { return genome()[GENOME_HEADER_SIZE + layer]; }
+
+    // Bit mask of the layers feeding `layer`.
+    uint64_t sources(uint32_t layer) const {
+        return genome()[GENOME_HEADER_SIZE + 2 * get_layer_count() + layer];
+    }
+
+    uint32_t input_count(uint32_t layer) const { return source_column(layer, layer); }
+
+    // First weight column of `source` in `layer`'s rows, whether or not it
+    // feeds the layer yet.
+    uint32_t source_column(uint32_t layer, uint32_t source) const {
+        uint32_t column = 0;
+        for (uint32_t s = 0; s < source; s++) {
+            if (sources(layer) & layer_bit(s)) column += node_count(s);
+        }
+        return column;
+    }
+
+    activation_type activation(uint32_t layer) const {
+        return (activation_type)(uint32_t)genome()[GENOME_HEADER_SIZE + get_layer_count() + layer];
+    }
+
+    void set_activation(uint32_t layer, activation_type type) {
+        touch(layer);
+        writable_genome()[GENOME_HEADER_SIZE + get_layer_count() + layer] = type;
+    }
+
+    // Activation given to layers created by random() and mutate_add_layer().
+    void set_default_activation(activation_type type) { _default_activation = type; }
+
+    // The writable views count as changing the layer; read through a const
+    // config where nothing is written.
+    double *thresholds(uint32_t layer) {
+        touch(layer);
+        return &writable_genome()[_offsets[layer]];
+    }
+    const double *thresholds(uint32_t layer) const { return &genome()[_offsets[layer]]; }
+
+    double *weights(uint32_t layer) { return thresholds(layer) + node_count(layer); }
+    const double *weights(uint32_t layer) const { return thresholds(layer) + node_count(layer); }
+
+    layer_config get_layer_config(uint32_t layer) const {
+        layer_config l;
+        l._node_count = node_count(layer);
+        l._input_count = input_count(layer);
+        l._sources = sources(layer);
+        l._activation = activation(layer);
+        l._thresholds = thresholds(layer);
+        l._weights = weights(layer);
+        l._id = layer_id(layer);
+        return l;
+    }
+
+    const std::vector<double> &genome() const { return *_genome; }
 
-    std::vector<layer_config> &get_layer_configs() { return _layer_configs; }
+    // All thresholds and weights, layer after layer, as one contiguous run.
+    double *genes() {
+        std::fill(_layer_ids.begin(), _layer_ids.end(), 0);
+        return &writable_genome()[_offsets[0]];
+    }
+    const double *genes() const { return &genome()[_offsets[0]]; }
+    uint32_t gene_count() const { return genome().size() - _offsets[0]; }
+
+    // Replace the genome with count genes laid out as described above.
+    void load_genome(const double *genes, uint32_t count) {
+        _genome = std::make_shared<std::vector<double>>(genes, genes + count);
+        update_offsets();
+        _layer_ids.assign(get_layer_count(), 0);
+    }
 
-    void set_input_neuron_count(uint32_t in) { _input_neuron_count = in; }
-    void set_output_neuron_count(uint32_t out) { _output_neuron_count = out; }
+    // Names the current genes of a layer, so networks built from configs
+    // that share a layer's id can share its weights. A copied config keeps
+    // the ids; writing a layer clears its id to 0 until stamp_layers().
+    uint64_t layer_id(uint32_t layer) const { return _layer_ids[layer]; }
+
+    // Give every layer whose id was cleared a new one, unique in the process.
+    void stamp_layers() {
+        static std::atomic<uint64_t> next_id(1);
+        for (auto &id : _layer_ids) {
+            if (!id) id = next_id++;
+        }
+    }
+
+    mutation_chart &get_mutation_chart() { return _mutation_chart; }
+    const mutation_chart &get_mutation_chart() const { return _mutation_chart; }
+
+    void set_input_neuron_count(uint32_t in) { writable_genome()[GENOME_INPUT_COUNT] = in; }
+    void set_output_neuron_count(uint32_t out) { writable_genome()[GENOME_OUTPUT_COUNT] = out; }
 
 private:
 
     uint32_t pick_layer(bool center_only = false) { 
-        uint32_t count = _layer_count;
+        uint32_t count = get_layer_count();
         if (center_only) { count--; }
 
         std::uniform_real_distribution<> layer_selector(1, count);
-        return layer_selector(_gen);
+        return draw(layer_selector);
     }
 
     uint32_t pick_node(uint32_t layer) {
-        std::uniform_real_distribution<> node_selector(0, _layer_configs[layer]._node_count);
-        return node_selector(_gen);
+        std::uniform_real_distribution<> node_selector(0, node_count(layer));
+        return draw(node_selector);
     }
 
     uint32_t pick_connection(uint32_t layer, uint32_t node) {
-        uint32_t connections_len = _layer_configs[layer]._node_configs[node]._connection_weights.size();
-        std::uniform_real_distribution<> connection_selector(0, connections_len);
-        return connection_selector(_gen);
+        std::uniform_real_distribution<> connection_selector(0, input_count(layer));
+        return draw(connection_selector);
+    }
+
+    double &weight(uint32_t layer, uint32_t node, uint32_t connection) {
+        return weights(layer)[node * input_count(layer) + connection];
+    }
+
+    void apply_mutation(mutation_op op, std::vector<mutation_record> *applied) {
+        if (applied) {
+            applied->push_back(mutation_record());
+            applied->back()._op = op;
+            _recording = &applied->back();
+        }
+        run_operator(op);
+        _recording = nullptr;
+    }
 
+    void run_operator(mutation_op op) {
+        switch (op) {
+        case MUTATE_THRESHOLD:          mutate_threshold();         break;
+        case MUTATE_WEIGHT:             mutate_weight();            break;
+        case MUTATE_STRENGTH:           mutate_mutation_strength(); break;
+        case MUTATE_ADD_NODE:           mutate_add_node();          break;
+        case MUTATE_INVERT_CONNECTION:  mutate_invert_connection(); break;
+        case MUTATE_DELETE_NODE:        mutate_delete_node();       break;
+        case MUTATE_ADD_LAYER:          mutate_add_layer();         break;
+        case MUTATE_ZERO_CONNECTION:    mutate_zero_connection();   break;
+        case MUTATE_DELETE_LAYER:       mutate_delete_layer();      break;
+        case MUTATE_ADD_SKIP:           mutate_add_skip();          break;
+        case MUTATE_DELETE_SKIP:        mutate_delete_skip();       break;
+        default:                        printf("Unknown mutation\n");
+        }
+    }
+
+    // Every random value a mutation operator uses comes through here, so it
+    // can be recorded, or taken from the record being replayed.
+    template <typename Distribution>
+    double draw(Distribution &distribution) {
+        if (_replaying) {
+            assert(_replay_position < _replaying->_draws.size());
+            return _replaying->_draws[_replay_position++];
+        }
+        double value = distribution(_gen);
+        if (_recording) _recording->_draws.push_back(value);
+        return value;
     }
 
     void mutate_weight() {
@@ -169,19 +423,19 @@ private:
         uint32_t node  = pick_node(layer);
         uint32_t connection = pick_connection(layer, node);
 
-        _layer_configs[layer]._node_configs[node]._connection_weights[connection] = _weight_distribution(_gen);
+        weight(layer, node, connection) = draw(_weight_distribution);
     }
 
     void mutate_threshold() {
         uint32_t layer = pick_layer();
         uint32_t node  = pick_node(layer);
 
-        _layer_configs[layer]._node_configs[node]._activation_threshold = _threshold_distribution(_gen);
+        thresholds(layer)[node] = draw(_threshold_distribution);
     }
 
     void mutate_mutation_strength() {
-        int32_t percent = _mutate_attribute_distribution(_gen);
-        if (_negative_selector(_gen) < 0) { percent *= -1; }
+        int32_t percent = draw(_mutate_attribute_distribution);
+        if (draw(_negative_selector) < 0) { percent *= -1; }
 
         mutation_chart old_chart = _mutation_chart;
 
@@ -220,6 +474,14 @@ private:
         temp = old_chart.zero_conn - old_chart.add_layer;
 
         _mutation_chart.zero_conn = temp - movement * temp / 100.0 + sum;
+        sum += _mutation_chart.zero_conn;
+        temp = old_chart.add_skip - old_chart.zero_conn;
+
+        _mutation_chart.add_skip = temp - movement * temp / 100.0 + sum;
+        sum += _mutation_chart.add_skip;
+        temp = old_chart.del_skip - old_chart.add_skip;
+
+        _mutation_chart.del_skip = temp - movement * temp / 100.0 + sum;
 
         // Leave del_layer where it was since it's at the top.
     }
@@ -227,63 +489,252 @@ private:
     void mutate_add_node() {
         bool center_only = true;
         uint32_t layer = pick_layer(center_only);
-        _layer_configs[layer]._node_count++;
-        _layer_configs[layer]._node_configs.push_back(node_config());
-        _layer_configs[layer]._node_configs.back()._activation_threshold = _threshold_distribution(_gen);
-        for (uint32_t l = 0; l < _layer_configs[layer - 1]._node_count; l++) {
-            _layer_configs[layer]._node_configs.back()._connection_weights.push_back(_weight_distribution(_gen));
+        uint32_t count = node_count(layer);
+        uint32_t inputs = input_count(layer);
+
+        // Every layer fed by this one gets a new column after its block.
+        for (uint32_t m = get_layer_count() - 1; m > layer; m--) {
+            if (!(sources(m) & layer_bit(layer))) continue;
+            remap_columns(m, replace_columns(input_count(m), source_column(m, layer) + count, 0, 1));
+        }
+
+        std::vector<double> block(thresholds(layer), thresholds(layer) + count);
+        block.push_back(draw(_threshold_distribution));
+        block.insert(block.end(), weights(layer), weights(layer) + count * inputs);
+        for (uint32_t l = 0; l < inputs; l++) {
+            block.push_back(draw(_weight_distribution));
         }
+        splice_layer(layer, block);
+        writable_genome()[GENOME_HEADER_SIZE + layer] = count + 1;
+        update_offsets();
     }
 
     void mutate_invert_connection() {
         uint32_t layer = pick_layer();
         uint32_t node = pick_node(layer);
         uint32_t connection = pick_connection(layer, node);
-        _layer_configs[layer]._node_configs[node]._connection_weights[connection] = 1 - _layer_configs[layer]._node_configs[node]._connection_weights[connection];
+        weight(layer, node, connection) = 1 - weight(layer, node, connection);
     }
 
     void mutate_delete_node() {
         bool center_only = true;
         uint32_t layer = pick_layer(center_only);
+        uint32_t count = node_count(layer);
+        if (count == 1) return;
         uint32_t node = pick_node(layer);
-        _layer_configs[layer]._node_count--;
-        _layer_configs[layer]._node_configs.erase(_layer_configs[layer]._node_configs.begin() + node);
+        uint32_t inputs = input_count(layer);
+        for (uint32_t m = get_layer_count() - 1; m > layer; m--) {
+            if (!(sources(m) & layer_bit(layer))) continue;
+            remap_columns(m, replace_columns(input_count(m), source_column(m, layer) + node, 1, 0));
+        }
+
+        std::vector<double> block;
+        block.reserve((count - 1) * (inputs + 1));
+        for (uint32_t n = 0; n < count; n++) {
+            if (n != node) block.push_back(thresholds(layer)[n]);
+        }
+        for (uint32_t n = 0; n < count; n++) {
+            if (n != node) block.insert(block.end(), weights(layer) + n * inputs, weights(layer) + (n + 1) * inputs);
+        }
+        splice_layer(layer, block);
+        writable_genome()[GENOME_HEADER_SIZE + layer] = count - 1;
+        update_offsets();
     }
 
+    // The new layer goes in front of `layer`, fed by the layer before it. It
+    // takes over that layer's place as a source of `layer`, or becomes an
+    // extra source if `layer` skipped it.
     void mutate_add_layer() {
         bool center_only = true;
         uint32_t layer = pick_layer(center_only);
-        _layer_count++;
-        _layer_configs.insert(_layer_configs.begin() + layer, layer_config());
-        uint32_t count = _node_count_distribution(_gen);
-        _layer_configs[layer]._node_count = count;
+        if (get_layer_count() == MAX_LAYER_COUNT) return;
+        uint32_t count = draw(_node_count_distribution);
+        uint32_t inputs = node_count(layer - 1);
+        uint64_t replaced = sources(layer) & layer_bit(layer - 1);
+        remap_columns(layer, replace_columns(input_count(layer), source_column(layer, layer - 1),
+                                             replaced ? inputs : 0, count));
+
+        std::vector<double> block;
         for (uint32_t j = 0; j < count; j++) {
-            _layer_configs[layer]._node_configs.push_back(node_config());
-            _layer_configs[layer]._node_configs[j]._activation_threshold = _threshold_distribution(_gen);
-            for (uint32_t l = 0; l < _layer_configs[layer - 1]._node_count; l++) {
-                _layer_configs[layer]._node_configs[j]._connection_weights.push_back(_weight_distribution(_gen));
-            }
+            block.push_back(draw(_threshold_distribution));
+        }
+        for (uint32_t j = 0; j < count * inputs; j++) {
+            block.push_back(draw(_weight_distribution));
         }
+        std::vector<uint64_t> masks = source_masks();
+        masks[layer] &= ~replaced;
+        masks.insert(masks.begin() + layer, layer_bit(layer - 1));
+        for (uint32_t m = layer + 1; m < masks.size(); m++) {
+            uint64_t below = layer_bit(layer) - 1;
+            masks[m] = (masks[m] & below) | ((masks[m] & ~below) << 1);
+        }
+        masks[layer + 1] |= layer_bit(layer);
+
+        uint32_t layer_count = get_layer_count();
+        std::vector<double> &genome = writable_genome();
+        genome.insert(genome.begin() + _offsets[layer], block.begin(), block.end());
+        genome.insert(genome.begin() + GENOME_HEADER_SIZE + 2 * layer_count + layer, 0);
+        genome.insert(genome.begin() + GENOME_HEADER_SIZE + layer_count + layer, _default_activation);
+        genome.insert(genome.begin() + GENOME_HEADER_SIZE + layer, count);
+        genome[GENOME_LAYER_COUNT] = layer_count + 1;
+        _layer_ids.insert(_layer_ids.begin() + layer, 0);
+        set_source_masks(masks);
+        update_offsets();
     }
 
     void mutate_zero_connection() {
         uint32_t layer = pick_layer();
         uint32_t node = pick_node(layer);
         uint32_t connection = pick_connection(layer, node);
-        _layer_configs[layer]._node_configs[node]._connection_weights[connection] = 0;
+        weight(layer, node, connection) = 0;
     }
 
+    // Layers fed by the deleted layer are fed by the one before it instead.
     void mutate_delete_layer() {
         bool center_only = true;
         uint32_t layer = pick_layer(center_only);
-        _layer_count--;
-        _layer_configs.erase(_layer_configs.begin() + layer);
+        uint32_t count = node_count(layer);
+        for (uint32_t m = get_layer_count() - 1; m > layer; m--) {
+            if (!(sources(m) & layer_bit(layer))) continue;
+            uint32_t replacement = sources(m) & layer_bit(layer - 1) ? 0 : node_count(layer - 1);
+            remap_columns(m, replace_columns(input_count(m), source_column(m, layer), count, replacement));
+        }
+        std::vector<uint64_t> masks = source_masks();
+        for (uint32_t m = layer + 1; m < masks.size(); m++) {
+            if (masks[m] & layer_bit(layer)) masks[m] |= layer_bit(layer - 1);
+            uint64_t below = layer_bit(layer) - 1;
+            masks[m] = (masks[m] & below) | ((masks[m] >> 1) & ~below);
+        }
+        masks.erase(masks.begin() + layer);
+
+        uint32_t layer_count = get_layer_count();
+        std::vector<double> &genome = writable_genome();
+        genome.erase(genome.begin() + _offsets[layer], genome.begin() + _offsets[layer + 1]);
+        genome.erase(genome.begin() + GENOME_HEADER_SIZE + 2 * layer_count + layer);
+        genome.erase(genome.begin() + GENOME_HEADER_SIZE + layer_count + layer);
+        genome.erase(genome.begin() + GENOME_HEADER_SIZE + layer);
+        genome[GENOME_LAYER_COUNT] = layer_count - 1;
+        _layer_ids.erase(_layer_ids.begin() + layer);
+        set_source_masks(masks);
+        update_offsets();
+    }
+
+    // Feed a layer from one more earlier layer, through random weights.
+    void mutate_add_skip() {
+        uint32_t layer = pick_layer();
+        uint64_t missing = (layer_bit(layer) - 1) & ~sources(layer);
+        if (!missing) return;
+        uint32_t source = pick_source(missing);
+        remap_columns(layer, replace_columns(input_count(layer), source_column(layer, source), 0, node_count(source)));
+        set_sources(layer, sources(layer) | layer_bit(source));
+        update_offsets();
+    }
+
+    // Cut one source from a layer that has more than one.
+    void mutate_delete_skip() {
+        uint32_t layer = pick_layer();
+        uint64_t mask = sources(layer);
+        if (!(mask & (mask - 1))) return;
+        uint32_t source = pick_source(mask);
+        remap_columns(layer, replace_columns(input_count(layer), source_column(layer, source), node_count(source), 0));
+        set_sources(layer, mask & ~layer_bit(source));
+        update_offsets();
+    }
+
+    // One of the layers in mask, uniformly.
+    uint32_t pick_source(uint64_t mask) {
+        uint32_t count = 0;
+        for (uint64_t m = mask; m; m &= m - 1) count++;
+        std::uniform_real_distribution<> source_selector(0, count);
+        uint32_t pick = draw(source_selector);
+        for (uint32_t s = 0; ; s++) {
+            if (!(mask & layer_bit(s))) continue;
+            if (!pick--) return s;
+        }
+    }
+
+    void set_sources(uint32_t layer, uint64_t mask) {
+        if (mask == sources(layer)) return;
+        touch(layer);
+        writable_genome()[GENOME_HEADER_SIZE + 2 * get_layer_count() + layer] = mask;
+    }
+
+    std::vector<uint64_t> source_masks() const {
+        std::vector<uint64_t> masks(get_layer_count());
+        for (uint32_t l = 0; l < masks.size(); l++) masks[l] = sources(l);
+        return masks;
+    }
+
+    void set_source_masks(const std::vector<uint64_t> &masks) {
+        for (uint32_t l = 0; l < masks.size(); l++) set_sources(l, masks[l]);
+    }
+
+    // Replace a layer's genes with block, shifting the rest of the genome once.
+    void splice_layer(uint32_t layer, const std::vector<double> &block) {
+        uint32_t begin = _offsets[layer];
+        uint32_t end = _offsets[layer + 1];
+        uint32_t length = end - begin;
+        std::vector<double> &genome = writable_genome();
+        if (block.size() > length) {
+            genome.insert(genome.begin() + end, block.size() - length, 0);
+        }
+        else {
+            genome.erase(genome.begin() + begin + block.size(), genome.begin() + end);
+        }
+        std::copy(block.begin(), block.end(), genome.begin() + begin);
+        touch(layer);
+    }
 
+    // Column map for remap_columns(): of `width` columns, the old_count from
+    // `at` on become new_count columns. The first of them are kept, the rest
+    // are new (-1).
+    static std::vector<int32_t> replace_columns(uint32_t width, uint32_t at, uint32_t old_count, uint32_t new_count) {
+        std::vector<int32_t> columns;
+        columns.reserve(width - old_count + new_count);
+        for (uint32_t c = 0; c < at; c++) columns.push_back(c);
+        for (uint32_t c = 0; c < new_count; c++) columns.push_back(c < old_count ? at + c : -1);
+        for (uint32_t c = at + old_count; c < width; c++) columns.push_back(c);
+        return columns;
+    }
+
+    // Rebuild a layer's weight rows: new column c is old column columns[c],
+    // or a random weight where that is -1. Only this layer's genes move, so
+    // callers remapping several layers go from the last to the first; they
+    // also update sizes, sources and offsets afterwards.
+    void remap_columns(uint32_t layer, const std::vector<int32_t> &columns) {
+        uint32_t count = node_count(layer);
+        uint32_t old_inputs = input_count(layer);
+        const double *rows = thresholds(layer) + count;
+
+        std::vector<double> block(thresholds(layer), thresholds(layer) + count);
+        block.reserve(count * (columns.size() + 1));
+        for (uint32_t n = 0; n < count; n++) {
+            for (int32_t c : columns) {
+                block.push_back(c < 0 ? draw(_weight_distribution) : rows[n * old_inputs + c]);
+            }
+        }
+        splice_layer(layer, block);
+    }
+
+    // The genome, copied first if another config shares it.
+    std::vector<double> &writable_genome() {
+        if (_genome.use_count() > 1) _genome = std::make_shared<std::vector<double>>(*_genome);
+        return *_genome;
+    }
+
+    void touch(uint32_t layer) { _layer_ids[layer] = 0; }
+
+    void update_offsets() {
+        uint32_t layer_count = get_layer_count();
+        _offsets.resize(layer_count + 1);
+        uint32_t offset = GENOME_HEADER_SIZE + 3 * layer_count;
+        for (uint32_t i = 0; i < layer_count; i++) {
+            _offsets[i] = offset;
+            offset += node_count(i) * (input_count(i) + 1);
+        }
+        _offsets[layer_count] = offset;
     }
 
-    uint32_t                 _layer_count = 0; 
-    uint32_t                 _input_neuron_count = 0;
-    uint32_t                 _output_neuron_count = 0;
     std::mt19937            &_gen;
     
     std::uniform_real_distribution<> _mutate_attribute_distribution;
@@ -294,7 +745,15 @@ private:
     std::uniform_real_distribution<> _negative_selector;
 
     mutation_chart           _mutation_chart;
-    std::vector<layer_config> _layer_configs;
+    activation_type          _default_activation = ACTIVATION_THRESHOLD;
+    std::shared_ptr<std::vector<double>> _genome;     // shared with copies until written
+    std::vector<uint32_t>    _offsets;   // index: layer, value: start of its genes; last entry is the end
+    std::vector<uint64_t>    _layer_ids; // index: layer, value: layer_id()
+
+    // Only set while one operator runs.
+    mutation_record         *_recording = nullptr;
+    const mutation_record   *_replaying = nullptr;
+    uint32_t                 _replay_position = 0;
 };
 
 }
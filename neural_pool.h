@@ -1,16 +1,23 @@
 #pragma once
 #include <unordered_map>
+#include <algorithm>
 #include <ctime>
 #include <thread>
 #include <chrono>
+#include <utility>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include "neural_structure.h"
+#include "genome_store.h"
+#include "mutation_journal.h"
+#include "perf_counters.h"
+#include "fitness_function.h"
 
 #ifndef __linux__
 #include "mingw.thread.h"
-#define SLEEP(x) std::this_thread::sleep_for(std::chrono::microseconds(x));
-#else
-#include <unistd.h>
-#define SLEEP(x) usleep(x);
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
 #endif
 
 
@@ -20,69 +27,333 @@ class neural_pool {
 public:
     neural_pool(uint32_t candidate_pool_size) :
         _size(candidate_pool_size),
-        _worker_count(std::thread::hardware_concurrency())
+        _max_workers(std::max(1u, std::thread::hardware_concurrency()))
     {}
 
     void init() {
-        std::srand(std::time(0));
-        _gen.seed(std::rand());
+        seed_pool();
         for (uint32_t i = 0; i < _size; i++) {
-            structure_config config(_gen);
-            config.set_input_neuron_count(5);
-            config.set_output_neuron_count(3);
-            config.random();
+            seed_candidate(i);
+            structure_config config = random_config();
             //config.describe();
             neural_structure *s = new neural_structure(_gen, config);
             s->init();
             _structures.push_back(s);
         }
+        // The random genomes used generation 0's streams; mutations start
+        // on fresh ones.
+        _epoch++;
+        // Worker threads are started lazily by the first generation that
+        // has enough work to need them.
+    }
 
-        uint32_t worker_data_index = 0;
-        uint32_t thread_set_size = _size / _worker_count;
-        uint32_t overflow = _size % _worker_count;
+    // Out-of-core counterpart of init(): write a random population straight
+    // into a freshly created store without building any networks.
+    bool init_store(genome_store &store) {
+        seed_pool();
+        for (uint32_t i = 0; i < _size; i++) {
+            seed_candidate(i);
+            structure_config config = random_config();
+            if (!store.append(config)) return false;
+        }
+        _epoch++;
+        return store.seal();
+    }
 
-        uint64_t mover = 1;
-        uint64_t compute = mover << _worker_count;
-        _workers_complete_indicator = compute - 1;
+    // Reproducible mode. Every candidate draws from its own random stream,
+    // derived from (seed, generation, index), and pipelined selection takes
+    // results in index order. A run is then bit-identical for a given seed
+    // whatever the worker count or thread timing.
+    void set_seed(uint64_t seed) {
+        _seed = seed;
+        _deterministic = true;
+    }
 
-        for (uint32_t i = 0; i < _worker_count; i++) {
-            std::vector<neural_structure *> temp;
-            for (uint32_t j = 0; j < thread_set_size; j++) {
-                temp.push_back(_structures[worker_data_index++]);
-            }
-            _worker_data.push_back(temp);
+    // Shape limits and mutation chart of the random genomes init() draws.
+    void set_genome_limits(uint32_t max_layer_count, uint32_t max_node_count) {
+        _max_layer_count = max_layer_count;
+        _max_node_count = max_node_count;
+    }
+
+    void set_mutation_chart(const mutation_chart &chart) { _chart = chart; }
+
+    // Have compute_pool() push only the inputs that changed since the last
+    // compute through each network; see neural_structure::update_network().
+    // Networks rebuilt since then are computed in full.
+    void set_incremental(bool incremental) { _incremental = incremental; }
+
+    // Mutate every structure in place, in index order, then rebuild the
+    // ones that changed.
+    void mutate_pool() {
+        perf_sample mark = perf_mark();
+        _changed.assign(_size, false);
+        for (uint32_t i = 0; i < _size; i++) {
+            seed_candidate(i);
+            _changed[i] = _structures[i]->get_config().mutate(true, start_recording());
+            journal_mutations(i);
         }
-        for (uint32_t j = 0; j < overflow; j++) {
-            _worker_data[0].push_back(_structures[worker_data_index++]);
+        perf_phase_end(PERF_MUTATE, mark);
+        for (uint32_t i = 0; i < _size; i++) {
+            if (_changed[i]) _structures[i]->rebuild();
         }
-        for (uint32_t i = 0; i < _worker_count; i++) {
-            _workers.push_back(std::thread(&neural_pool::worker_thread, this, i));
+        perf_phase_end(PERF_REBUILD, mark);
+        _epoch++;
+        end_perf_generation(_epoch - 1);
+    }
+
+    // Replace the population with offspring: candidate i becomes a mutated
+    // copy of candidate parents[i]. An offspring shares its parent's genome
+    // and the weights of every layer its mutation left alone, so filling
+    // most of the pool with copies of a few top candidates costs little
+    // memory or time. The journal gets each parent ahead of the mutations.
+    void reproduce_pool(const std::vector<uint32_t> &parents) {
+        assert(parents.size() == _size);
+        perf_sample mark = perf_mark();
+        fill_back_buffer();
+        for (uint32_t i = 0; i < _size; i++) {
+            seed_candidate(i);
+            structure_config &offspring = _back_structures[i]->get_config();
+            offspring = _structures[parents[i]]->get_config();
+            if (_journal) _journal->log_parent(_epoch, i, parents[i]);
+            offspring.mutate(true, start_recording());
+            journal_mutations(i);
         }
-        wait_for_workers();
+        perf_phase_end(PERF_MUTATE, mark);
+        for (uint32_t i = 0; i < _size; i++) {
+            _back_structures[i]->rebuild_from(*_structures[parents[i]]);
+        }
+        perf_phase_end(PERF_REBUILD, mark);
+        _structures.swap(_back_structures);
+        _epoch++;
+        end_perf_generation(_epoch - 1);
+    }
+
+    // Count cycles, instructions, L1D and LLC read misses and branch misses
+    // on every pool thread, split by phase: evaluation on the workers (or
+    // the caller, when it runs a small batch itself), mutation and rebuilds
+    // on the caller. Totals are kept per generation and, if print is set,
+    // printed as each generation ends. Reading the counters costs a system
+    // call per phase boundary; the pipelined path has three per candidate.
+    void set_perf_counters(bool enable, bool print = true) {
+        if (enable && !_caller_perf.open()) {
+            printf("neural_pool: hardware counters unavailable, perf reports will be empty\n");
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        _perf = enable;
+        _print_perf = print;
+        _perf_totals.assign(_workers.size() + 1, perf_phases());
     }
 
-    void feed_inputs(std::vector<double> &inputs) {
+    // Counts of the last finished generation; index 0 is the caller, i the
+    // worker i - 1.
+    const std::vector<perf_phases> &last_perf() { return _last_perf; }
+
+    // Log every mutation applied from now on, tagged with epoch(), or stop
+    // logging with nullptr. The journal must stay open while it is set.
+    void set_journal(mutation_journal *journal) { _journal = journal; }
+
+    // Evolutionary generations so far; the generation the next mutations
+    // are logged under.
+    uint64_t epoch() { return _epoch; }
+
+    // Write the current generation to a freshly created store and seal it.
+    // With the journal kept from here on, this is a recovery point.
+    bool snapshot(genome_store &store) {
         for (auto &s : _structures) {
-            s->fill_input_neurons(inputs);
+            if (!store.append(s->get_config())) return false;
         }
+        return store.seal();
     }
 
-    void compute_pool() { 
-        //for (auto &s : _structures) {
-        //    s->compute_network();
-        //    printf("Computing network\n");
-        //}
-        _workers_finished = 0; // Signal to start.
-        wait_for_workers();
+    // Rebuild the population of generation `epoch` from a snapshot taken at
+    // generation `snapshot_epoch` and the journal written since.
+    bool restore(genome_store &snapshot, uint64_t snapshot_epoch, const char *journal, uint64_t epoch) {
+        std::vector<structure_config> population(snapshot.size(), structure_config(_gen));
+        for (uint64_t i = 0; i < snapshot.size(); i++) {
+            snapshot.load(i, population[i]);
+        }
+        if (!mutation_journal::replay(journal, snapshot_epoch, epoch, population)) return false;
+
+        for (auto &s : _structures) delete s;
+        for (auto &s : _back_structures) delete s;
+        _structures.clear();
+        _back_structures.clear();
+        for (auto &config : population) {
+            neural_structure *s = new neural_structure(_gen, config);
+            s->init();
+            _structures.push_back(s);
+        }
+        _size = _structures.size();
+        _epoch = epoch;
+        return true;
     }
 
-    void wait_for_workers() {
-        while (true) {
-            if (_workers_finished == _workers_complete_indicator) {
-                break;
+    // Copy inputs once into the pool's shared, cache-line aligned buffer.
+    // On every later compute each network's first hidden layer reads that
+    // buffer in place, so nothing is copied per structure.
+    void feed_inputs(const std::vector<double> &inputs) {
+        _input_storage.resize(inputs.size() + 64 / sizeof(double));
+        double *aligned = (double *)(((uintptr_t)_input_storage.data() + 63) & ~(uintptr_t)63);
+        std::copy(inputs.begin(), inputs.end(), aligned);
+        _inputs = aligned;
+        _input_count = inputs.size();
+    }
+
+    void compute_pool() {
+        run(desired_workers(_size), _size, std::bind(&neural_pool::compute_slice, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // Out-of-core evaluation: the population lives in store rather than in
+    // _structures. Each worker streams its contiguous slice of records,
+    // materializing one network at a time, and hands it to score(index, s)
+    // on the worker thread.
+    template <typename Scorer>
+    void compute_store(genome_store &store, std::vector<double> &inputs, Scorer score) {
+        uint32_t count = store.size();
+        uint32_t workers = desired_workers(count);
+        while (_scratch.size() < std::max(1u, workers)) {
+            _scratch.push_back(new neural_structure(_gen, structure_config(_gen)));
+        }
+        run(workers, count, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            neural_structure *s = _scratch[worker];
+            for (uint32_t j = begin; j < end; j++) {
+                store.load(j, s->get_config());
+                s->rebuild();
+                s->bind_inputs(inputs.data(), inputs.size());
+                s->compute_network();
+                score(j, s);
             }
-            SLEEP(10);
+        });
+    }
+
+    // Score every structure over all test cases on the workers; scores is
+    // indexed like get_structures().
+    void evaluate_pool(const std::vector<test_case> &cases,
+                       const fitness_function &fitness,
+                       std::vector<double> &scores) {
+        scores.resize(_size);
+        run(desired_workers(_size), _size, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            for (uint32_t j = begin; j < end; j++) {
+                scores[j] = evaluate_structure(_structures[j], cases, fitness);
+            }
+        });
+    }
+
+    // evaluate_pool() for a population held in a genome_store.
+    void evaluate_store(genome_store &store,
+                        const std::vector<test_case> &cases,
+                        const fitness_function &fitness,
+                        std::vector<double> &scores) {
+        uint32_t count = store.size();
+        uint32_t workers = desired_workers(count);
+        while (_scratch.size() < std::max(1u, workers)) {
+            _scratch.push_back(new neural_structure(_gen, structure_config(_gen)));
+        }
+        scores.resize(count);
+        run(workers, count, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            neural_structure *s = _scratch[worker];
+            for (uint32_t j = begin; j < end; j++) {
+                store.load(j, s->get_config());
+                s->rebuild();
+                scores[j] = evaluate_structure(s, cases, fitness);
+            }
+        });
+    }
+
+    // Stream parents front to back, appending one mutated offspring per
+    // parent to a freshly created store, then seal it.
+    bool reproduce_store(genome_store &parents, genome_store &offspring) {
+        structure_config config(_gen);
+        for (uint64_t i = 0; i < parents.size(); i++) {
+            parents.load(i, config);
+            seed_candidate(i);
+            config.mutate(true, start_recording());
+            journal_mutations(i);
+            if (!offspring.append(config)) return false;
+        }
+        _epoch++;
+        end_perf_generation(_epoch - 1);
+        return offspring.seal();
+    }
+
+    // Evaluate the current generation while the main thread builds the next
+    // generation's offspring into the back buffer. Each worker's slice is
+    // handed to select() as soon as that worker finishes. Returns true once
+    // select() accepts a structure, otherwise swaps buffers for the next call.
+    // Offspring are journaled, and the epoch advanced, only on a swap: an
+    // accepted generation stays the current one.
+    template <typename Selector>
+    bool compute_pool_pipelined(std::vector<double> &inputs, Selector select) {
+        fill_back_buffer();
+
+        uint32_t workers = std::max(1u, desired_workers(_size));
+        std::vector<bool> consumed(workers, false);
+        uint32_t remaining = workers;
+        bool selected = false;
+        _offspring_records.resize(_size);
+
+        feed_inputs(inputs);
+        start_workers(workers);
+        perf_sample mark = perf_mark();
+        for (uint32_t i = 0; i < _size && !selected; i++) {
+            seed_candidate(i);
+            structure_config &offspring = _back_structures[i]->get_config();
+            offspring = _structures[i]->get_config();
+            offspring.mutate(true, start_recording());
+            _offspring_records[i].swap(_applied);
+            perf_phase_end(PERF_MUTATE, mark);
+            _back_structures[i]->rebuild_from(*_structures[i]);
+            perf_phase_end(PERF_REBUILD, mark);
+            remaining -= consume_finished_slices(consumed, select, selected, false);
+            perf_phase_end(PERF_EVALUATE, mark);
+        }
+        while (remaining) {
+            remaining -= consume_finished_slices(consumed, select, selected, true);
         }
+
+        end_perf_generation(_epoch);
+        if (selected) return true;
+        for (uint32_t i = 0; i < _size; i++) {
+            _applied.swap(_offspring_records[i]);
+            journal_mutations(i);
+        }
+        _epoch++;
+        _structures.swap(_back_structures);
+        return false;
+    }
+
+    // Hand the current generation to the first `workers` threads, starting
+    // or retiring threads so that exactly that many exist.
+    void start_workers(uint32_t workers) {
+        start_workers(workers, _size, std::bind(&neural_pool::compute_slice, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    // Split `count` items across `workers` threads, each running task over
+    // its own contiguous [begin, end) range.
+    // Only measured tasks feed the per-candidate cost model.
+    void start_workers(uint32_t workers, uint32_t count, std::function<void(uint32_t, uint32_t, uint32_t)> task,
+                       bool measure = true) {
+        resize_workers(workers);
+        std::lock_guard<std::mutex> lock(_lock);
+        _task = task;
+        _task_size = measure ? count : 0;
+        partition(workers, count);
+        _worker_done.assign(workers, false);
+        _pending = workers;
+        _generation++;
+        _start_cv.notify_all();
+    }
+
+    bool worker_finished(uint32_t i) {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _worker_done[i];
+    }
+
+    void wait_for_workers() {
+        std::unique_lock<std::mutex> lock(_lock);
+        _done_cv.wait(lock, [this] { return _pending == 0; });
     }
 
     void enumerate_pool() {
@@ -91,16 +362,31 @@ public:
         }
     }
 
-    void worker_thread(uint32_t i) {
-        uint32_t mask = 1 << i;
-        _workers_finished |= mask; // Mark self started.
-        while (!_stop_threads) {
-            while (_workers_finished & mask) SLEEP(10); // Wait for start signal when workers_finished goes to 0.
-            if (_stop_threads) return;
-            for (auto &s : _worker_data[i]) {
-                s->compute_network();
-            }
-            _workers_finished |= mask;
+    void worker_thread(uint32_t i, uint64_t seen) {
+        perf_group counters;
+        std::unique_lock<std::mutex> lock(_lock);
+        while (true) {
+            _start_cv.wait(lock, [&] { return i >= _worker_limit || _generation != seen; });
+            if (i >= _worker_limit) return;
+            seen = _generation;
+            uint32_t begin = _worker_ranges[i].first;
+            uint32_t end = _worker_ranges[i].second;
+            bool count = _perf && _task_size && counters.open();
+            lock.unlock();
+
+            perf_sample before, after;
+            if (count) counters.read(before);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            _task(i, begin, end);
+            uint64_t busy = elapsed_ns(start);
+            if (count) counters.read(after);
+
+            lock.lock();
+            if (count) _perf_totals[i + 1]._phases[PERF_EVALUATE] += after - before;
+            _busy_ns += busy;
+            _worker_done[i] = true;
+            if (--_pending == 0) record_cost(_busy_ns, _task_size);
+            _done_cv.notify_all();
         }
     }
 
@@ -108,23 +394,266 @@ public:
         return _structures;
     }
 
+    // Upper bound on threads; defaults to hardware_concurrency().
+    void set_max_workers(uint32_t workers) { _max_workers = std::max(1u, workers); }
+
+    // A worker is only worth waking if its slice takes at least this long.
+    void set_min_slice_time(uint64_t ns) { _min_slice_ns = ns; }
+
+    uint32_t worker_count() { return _workers.size(); }
+
+    uint32_t max_workers() { return _max_workers; }
+
+    // Run task(worker, begin, end) over count items on up to `workers`
+    // threads of the pool and wait. For cheap bookkeeping passes, such as
+    // selection, that should not disturb the candidate cost model.
+    void parallel_for(uint32_t workers, uint32_t count, std::function<void(uint32_t, uint32_t, uint32_t)> task) {
+        workers = std::max(1u, std::min(std::min(workers, _max_workers), count));
+        if (workers == 1) {
+            task(0, 0, count);
+            return;
+        }
+        start_workers(workers, count, task, false);
+        wait_for_workers();
+    }
+
+    double candidate_cost_ns() { return _candidate_cost_ns; }
+
     ~neural_pool() {
-        _stop_threads = 1;
-        _workers_finished = 0;
+        resize_workers(0);
         for (auto &s : _structures) delete s;
-        for (auto &t : _workers)    t.join();
+        for (auto &s : _back_structures) delete s;
+        for (auto &s : _scratch) delete s;
     }
 
 private:
+    // Offspring buffer for the pipelined path and reproduce_pool(); its
+    // networks are rebuilt before use.
+    void fill_back_buffer() {
+        if (!_back_structures.empty()) return;
+        for (auto &s : _structures) {
+            _back_structures.push_back(new neural_structure(_gen, s->get_config()));
+        }
+    }
+
+    void seed_pool() {
+        if (_deterministic) return;
+        std::srand(std::time(0));
+        _gen.seed(std::rand());
+    }
+
+    // In reproducible mode, point the shared generator at candidate i's
+    // stream for the current generation, so what it draws does not depend
+    // on how many other candidates were generated before it.
+    void seed_candidate(uint64_t i) {
+        if (!_deterministic) return;
+        uint64_t z = splitmix64(splitmix64(_seed ^ splitmix64(_epoch)) ^ i);
+        _gen.seed((std::mt19937::result_type)(z ^ (z >> 32)));
+    }
+
+    std::vector<mutation_record> *start_recording() {
+        if (!_journal) return nullptr;
+        _applied.clear();
+        return &_applied;
+    }
+
+    void journal_mutations(uint32_t candidate) {
+        if (_journal && !_applied.empty()) _journal->log(_epoch, candidate, _applied);
+    }
+
+    // The caller thread's counters now; zeros unless counting.
+    perf_sample perf_mark() {
+        perf_sample now;
+        if (_perf && _caller_perf.open()) _caller_perf.read(now);
+        return now;
+    }
+
+    // Add the caller's counts since mark to phase and move mark to now.
+    void perf_phase_end(perf_phase phase, perf_sample &mark) {
+        if (!_perf) return;
+        perf_sample now = perf_mark();
+        std::lock_guard<std::mutex> lock(_lock);
+        _perf_totals[0]._phases[phase] += now - mark;
+        mark = now;
+    }
+
+    // generation: the one that was just computed or mutated.
+    void end_perf_generation(uint64_t generation) {
+        if (!_perf) return;
+        std::lock_guard<std::mutex> lock(_lock);
+        _last_perf = _perf_totals;
+        _perf_totals.assign(_perf_totals.size(), perf_phases());
+        if (_print_perf) print_perf(generation, _last_perf);
+    }
+
+    structure_config random_config() {
+        structure_config config(_gen, _max_layer_count, _max_node_count);
+        config.get_mutation_chart() = _chart;
+        config.set_input_neuron_count(5);
+        config.set_output_neuron_count(3);
+        config.random();
+        return config;
+    }
+
+    void compute_slice(uint32_t worker, uint32_t begin, uint32_t end) {
+        for (uint32_t j = begin; j < end; j++) {
+            if (_incremental && _inputs) {
+                _structures[j]->update_network(_inputs, _input_count);
+                continue;
+            }
+            if (_inputs) _structures[j]->bind_inputs(_inputs, _input_count);
+            _structures[j]->compute_network();
+        }
+    }
+
+    // Run task over count items and wait. Too little work to be worth a
+    // wake-up is done on the caller.
+    void run(uint32_t workers, uint32_t count, std::function<void(uint32_t, uint32_t, uint32_t)> task) {
+        if (workers <= 1) {
+            perf_sample mark = perf_mark();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            task(0, 0, count);
+            record_cost(elapsed_ns(start), count);
+            perf_phase_end(PERF_EVALUATE, mark);
+            return;
+        }
+        start_workers(workers, count, task);
+        wait_for_workers();
+    }
+
+    // Size the team from the population and the measured cost of one
+    // candidate so each worker gets at least _min_slice_ns of work. Until a
+    // cost has been measured the pool runs single threaded.
+    uint32_t desired_workers(uint32_t count) {
+        if (_candidate_cost_ns <= 0) return 1;
+        double total = _candidate_cost_ns * count;
+        uint32_t workers = total / _min_slice_ns;
+        workers = std::min(workers, _max_workers);
+        workers = std::min(workers, count);
+        return std::max(1u, workers);
+    }
+
+    void resize_workers(uint32_t workers) {
+        if (workers < _workers.size()) {
+            {
+                std::lock_guard<std::mutex> lock(_lock);
+                _worker_limit = workers;
+                _start_cv.notify_all();
+            }
+            for (uint32_t i = workers; i < _workers.size(); i++) {
+                _workers[i].join();
+            }
+            _workers.resize(workers);
+        }
+        std::lock_guard<std::mutex> lock(_lock);
+        _worker_limit = workers;
+        if (_perf_totals.size() < workers + 1) _perf_totals.resize(workers + 1);
+        while (_workers.size() < workers) {
+            _workers.push_back(std::thread(&neural_pool::worker_thread, this, (uint32_t)_workers.size(), _generation));
+        }
+    }
+
+    // Spread the population evenly; the first `overflow` workers take one extra.
+    void partition(uint32_t workers, uint32_t count) {
+        uint32_t thread_set_size = count / workers;
+        uint32_t overflow = count % workers;
+        uint32_t index = 0;
+        _worker_ranges.clear();
+        for (uint32_t i = 0; i < workers; i++) {
+            uint32_t begin = index;
+            index += thread_set_size + (i < overflow ? 1 : 0);
+            _worker_ranges.push_back(std::make_pair(begin, index));
+        }
+        _busy_ns = 0;
+    }
+
+    void record_cost(uint64_t busy_ns, uint32_t count) {
+        if (!count) return;
+        double cost = (double)busy_ns / count;
+        if (_candidate_cost_ns <= 0) _candidate_cost_ns = cost;
+        else _candidate_cost_ns = _candidate_cost_ns * .75 + cost * .25;
+    }
+
+    static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <typename Selector>
+    uint32_t consume_finished_slices(std::vector<bool> &consumed, Selector &select, bool &selected, bool block) {
+        std::vector<bool> done;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            if (block) {
+                _done_cv.wait(lock, [&] {
+                    for (uint32_t w = 0; w < consumed.size(); w++) {
+                        if (consumed[w]) continue;
+                        if (_worker_done[w]) return true;
+                        if (_deterministic) return false;
+                    }
+                    return false;
+                });
+            }
+            done = _worker_done;
+        }
+
+        uint32_t count = 0;
+        for (uint32_t w = 0; w < consumed.size(); w++) {
+            if (consumed[w]) continue;
+            if (!done[w]) {
+                if (_deterministic) break; // Keep index order.
+                continue;
+            }
+            consumed[w] = true;
+            count++;
+            for (uint32_t j = _worker_ranges[w].first; j < _worker_ranges[w].second && !selected; j++) {
+                selected = select(_structures[j]);
+            }
+        }
+        return count;
+    }
+
     uint32_t           _size = 0;
-    uint64_t           _worker_count = 0;
-    volatile bool      _stop_threads = 0;
-    volatile uint64_t  _workers_finished = 0;
-    uint64_t           _workers_complete_indicator = 0;
+    uint32_t           _max_workers = 0;
+    uint32_t           _worker_limit = 0;
+    uint32_t           _pending = 0;
+    uint32_t           _task_size = 0;
+    uint64_t           _generation = 0;    // worker dispatches
+    uint64_t           _epoch = 0;         // evolutionary generations
+    uint64_t           _seed = 0;
+    bool               _deterministic = false;
+    bool               _incremental = false;
+    uint32_t           _max_layer_count = 7;
+    uint32_t           _max_node_count = 10;
+    mutation_chart     _chart;
+    uint64_t           _busy_ns = 0;
+    uint64_t           _min_slice_ns = 50000;
+    double             _candidate_cost_ns = 0;
     std::mt19937       _gen;
+    mutation_journal  *_journal = nullptr;
+    bool               _perf = false;
+    bool               _print_perf = false;
+    perf_group         _caller_perf;
+    const double      *_inputs = nullptr;      // into _input_storage, once fed
+    uint32_t           _input_count = 0;
+
+    std::vector<double>                                         _input_storage;
+    std::vector<bool>                                           _changed;   // index: candidate, mutated this generation
+    std::vector<std::vector<mutation_record>>                   _offspring_records; // index: candidate, pipelined mutations not yet journaled
+    std::vector<perf_phases>                                    _perf_totals;   // index: 0 caller, i worker i - 1
+    std::vector<perf_phases>                                    _last_perf;
+    std::vector<mutation_record>                                _applied;   // mutations of the candidate being journaled
+
+    std::mutex                                                  _lock;
+    std::condition_variable                                     _start_cv;
+    std::condition_variable                                     _done_cv;
+    std::vector<bool>                                           _worker_done;
+    std::function<void(uint32_t, uint32_t, uint32_t)>           _task;
 
     std::vector<neural_structure *>                             _structures;
-    std::vector<std::vector<neural_structure *> >               _worker_data;
+    std::vector<neural_structure *>                             _back_structures;
+    std::vector<std::pair<uint32_t, uint32_t> >                 _worker_ranges;
+    std::vector<neural_structure *>                             _scratch;   // index: worker, materialized store record
     std::vector<std::thread>                                    _workers;
 };
 
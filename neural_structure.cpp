@@ -1,53 +1,150 @@
 #include <stdio.h>
 #include "neural_structure.h"
+#include "neural_simd.h"
 
 namespace nn {
 
 class neural_layer;
 
-double
-neural_connection::compute_link_value() {
-    return _back_link->value() * _weight;
+void
+neural_layer::connect_sources(const std::vector<neural_layer *> &layers) {
+    _blocks.clear();
+    _input_count = 0;
+    for (uint32_t s = 0; s < layers.size(); s++) {
+        if (!(_config._sources & layer_bit(s))) continue;
+        input_block b;
+        b._source = s;
+        b._count = layers[s]->node_count();
+        b._values = layers[s]->values();
+        _blocks.push_back(b);
+        _input_count += b._count;
+    }
+    assert(_config._input_count == _input_count);
 }
 
-void 
-neural_node::connect_back_nodes(neural_layer *l) {
-    uint32_t index = 0;
-    for (auto &node : l->get_nodes()) {
-        neural_connection *connection = new neural_connection();
-        connection->update_back_link(node);
-        connection->update_weight_and_sigmoid(_config._connection_weights[index++]);
-        _connections.push_back(connection);
+void
+neural_layer::compute(uint32_t begin, uint32_t end) {
+    for (uint32_t n = begin; n < end; n++) {
+        const double *row = &_weights[n * _input_count];
+        double sum = 0;
+        for (auto &b : _blocks) {
+            sum += simd::dot(row, b._values, b._count);
+            row += b._count;
+        }
+        _sums[n] = sum;
+        _values[n] = sum;
     }
+    activate_layer(_config._activation, &_values[begin], &_thresholds[begin], end - begin);
 }
 
 void
-neural_node::compute() {
-    _value = 0;
-    for (auto &connection : _connections) {
-        _value += connection->compute_link_value();
+neural_layer::propagate(const std::vector<neural_layer *> &layers) {
+    _changed.clear();
+    _deltas.clear();
+    bool touched = false;
+    for (auto &b : _blocks) touched |= !layers[b._source]->_changed.empty();
+    if (!touched) return;
+
+    uint32_t column = 0;
+    for (auto &b : _blocks) {
+        const neural_layer *source = layers[b._source];
+        uint32_t changes = source->_changed.size();
+        for (uint32_t n = 0; changes && n < _node_count; n++) {
+            const double *row = &_weights[n * _input_count + column];
+            double sum = 0;
+            for (uint32_t i = 0; i < changes; i++) {
+                sum += row[source->_changed[i]] * source->_deltas[i];
+            }
+            _sums[n] += sum;
+        }
+        column += b._count;
+    }
+    for (uint32_t n = 0; n < _node_count; n++) {
+        double value = activate(_config._activation, _sums[n], _thresholds[n]);
+        if (value == _values[n]) continue;
+        _changed.push_back(n);
+        _deltas.push_back(value - _values[n]);
+        _values[n] = value;
+    }
+}
+
+void
+neural_layer::set_values(const double *values) {
+    _changed.clear();
+    _deltas.clear();
+    for (uint32_t n = 0; n < _node_count; n++) {
+        if (values[n] == _values[n]) continue;
+        _changed.push_back(n);
+        _deltas.push_back(values[n] - _values[n]);
+        _values[n] = values[n];
     }
-    flatten_and_converge();
 }
 
 void 
-neural_structure::fill_input_neurons(std::vector<double> &inputs) {
+neural_structure::fill_input_neurons(const std::vector<double> &inputs) {
     assert((size_t)inputs.size() == (size_t)_layers[0]->node_count());
-    std::vector<neural_node *> &input_nodes = _layers[0]->get_nodes();
-    uint32_t input_size = inputs.size();
-    for (uint32_t i = 0; i < input_size; i++) {
-        input_nodes[i]->update_value(inputs[i]);
-    }
+    std::copy(inputs.begin(), inputs.end(), _layers[0]->values());
+    for (uint32_t l = 1; l < _layer_count; l++) _layers[l]->set_inputs(0, _layers[0]->values());
 }
 
 
 void
 neural_structure::compute_network() {
-    for (uint32_t layer_index = 1; layer_index < _layer_count; layer_index++) {
-        std::vector<neural_node *> &nodes = _layers[layer_index]->get_nodes();
-        for (auto &node : nodes) {
-            node->compute();
+    _primed = false;
+    bool wide = false;
+    if (_team && _team->size() > 1) {
+        for (uint32_t layer_index = 1; layer_index < _layer_count; layer_index++) {
+            wide |= _layers[layer_index]->work() >= _min_parallel_work;
+        }
+    }
+    if (!wide) {
+        for (auto &level : _levels) {
+            for (uint32_t layer_index : level) _layers[layer_index]->compute();
+        }
+        return;
+    }
+    _team->run([this](uint32_t member, uint32_t size) { compute_team(member, size); });
+}
+
+void
+neural_structure::update_network(const double *inputs, uint32_t count) {
+    assert(count == _layers[0]->node_count());
+    if (!_primed || ++_updates >= _refresh_interval) {
+        fill_input_neurons(std::vector<double>(inputs, inputs + count));
+        compute_network();
+        _primed = true;
+        _updates = 0;
+        return;
+    }
+    _layers[0]->set_values(inputs);
+    for (auto &level : _levels) {
+        for (uint32_t layer_index : level) _layers[layer_index]->propagate(_layers);
+    }
+}
+
+// One member's share of every level. Wide layers are split into runs of
+// whole cache lines of values so members never write the same line; narrow
+// ones are dealt out whole, round robin, so the narrow layers of one level
+// run side by side. Levels read the levels before them, hence the barrier.
+void
+neural_structure::compute_team(uint32_t member, uint32_t size) {
+    const uint32_t line = 64 / sizeof(double);
+    for (uint32_t level = 0; level < _levels.size(); level++) {
+        uint32_t narrow = 0;
+        for (uint32_t layer_index : _levels[level]) {
+            neural_layer *layer = _layers[layer_index];
+            uint32_t nodes = layer->node_count();
+            if (layer->work() >= _min_parallel_work) {
+                uint32_t lines = (nodes + line - 1) / line;
+                uint32_t begin = std::min(nodes, lines * member / size * line);
+                uint32_t end = std::min(nodes, lines * (member + 1) / size * line);
+                if (begin < end) layer->compute(begin, end);
+            }
+            else if (narrow++ % size == member) {
+                layer->compute();
+            }
         }
+        if (level + 1 < _levels.size()) _team->barrier();
     }
 }
 
@@ -1,84 +1,65 @@
 #pragma once
 #include <assert.h>
 #include <stdlib.h>
+#include <memory>
 #include "neural_map.h"
+#include "thread_team.h"
 
 namespace nn {
 
-class neural_node;
 class neural_layer;
-class neural_connection {
-public:
-    neural_connection() {}
-
-    void update_weight(double weight) { _weight = weight; }
-    void update_back_link(neural_node *node) { _back_link = node; }
-
-    void update_weight_and_sigmoid(double weight) {
-        _weight = (weight/(1+std::abs(weight)));
-    }
-
-    double compute_link_value();
-
-private:
-    double _weight = 0;
-    neural_node *_back_link= nullptr;
-};
 
+// Handle on one node's value. The values themselves live contiguously in
+// the owning layer so a whole layer is computed and activated at once.
 class neural_node {
 
 public:
     neural_node(std::mt19937 &gen,
-                node_config &config)
+                node_config config,
+                double *value)
         : _gen(gen),
-          _config(config) {
-        _activation_threshold = _config._activation_threshold;
-    }
+          _config(config),
+          _value(value) {}
 
-    void connect_back_nodes(neural_layer *l);
+    void update_value(double value) { *_value = value; }
 
-    void update_value(double value) { _value = value; }
+    double value() { return *_value; }
 
-    double value() { return _value; }
-
-    void flatten_and_converge() {
-        _value = (_value/(1+std::abs(_value))); // Apply Sigmoid.
-        if (_value > _activation_threshold) {
-            _value = 1;
-        }
-        else {
-            _value = 0;
-        }
-    }
-
-    void compute();
-
-    ~neural_node() {
-        for (auto &c : _connections) {
-            delete c;
-        }
-    }
+    double activation_threshold() { return _config._activation_threshold; }
 
 private:
-    double                              _value = 0;
-    double                              _activation_threshold = 0;
     std::mt19937                       &_gen;
-    node_config                        &_config;
-    std::vector<neural_connection *>    _connections;
+    node_config                         _config;
+    double                             *_value;
+};
+
+// A layer's thresholds and squashed weights. Never written once built, so
+// every network whose config has the same layer_id() for a layer uses one.
+struct layer_weights {
+    uint64_t                _id = 0;
+    std::vector<double>     _thresholds;    // index: node
+    std::vector<double>     _weights;       // index: node * input count + input
 };
 
 class neural_layer {
 
 public:
     neural_layer(std::mt19937 &gen,
-                 layer_config &config)
+                 layer_config config)
         : _gen(gen),
           _config(config) {}
 
-    void init() {
+    // Use shared for the thresholds and weights if given, otherwise build
+    // them from the config.
+    void init(std::shared_ptr<const layer_weights> shared = nullptr) {
         _node_count = _config._node_count;
+        _values.assign(_node_count, 0);
+        _sums.assign(_node_count, 0);
+        _shared = shared ? shared : build_weights();
+        _thresholds = _shared->_thresholds.data();
+        _weights = _shared->_weights.data();
         for (uint32_t i = 0; i < _node_count; i++) {
-            neural_node *node = new neural_node(_gen, _config._node_configs[i]);
+            neural_node *node = new neural_node(_gen, _config.node(i), &_values[i]);
             _nodes.push_back(node);
         }
     }
@@ -89,25 +70,83 @@ public:
         }
     }
 
-    void connect_back_layer(neural_layer *l) {
-        for (auto &n : _nodes) {
-            n->connect_back_nodes(l);
+    // Read the values of every source layer, in layer order.
+    void connect_sources(const std::vector<neural_layer *> &layers);
+
+    // Weighted sums of the inputs, then the layer's activation.
+    void compute() { compute(0, _node_count); }
+
+    // The same for nodes [begin, end) only.
+    void compute(uint32_t begin, uint32_t end);
+
+    // Multiply-adds in one compute().
+    uint32_t work() { return _node_count * _input_count; }
+
+    // Incremental evaluation, see neural_structure::update_network(). Fold
+    // the value changes the source layers recorded into this layer's sums,
+    // re-activate, and record which of this layer's values changed in turn.
+    void propagate(const std::vector<neural_layer *> &layers);
+
+    // Overwrite the values of an input layer, recording the ones that changed.
+    void set_values(const double *values);
+
+    // Read source's values from here instead of from that layer. Does
+    // nothing if source does not feed this layer.
+    void set_inputs(uint32_t source, const double *inputs) {
+        for (auto &b : _blocks) {
+            if (b._source == source) b._values = inputs;
         }
     }
 
+    const std::shared_ptr<const layer_weights> &get_weights() { return _shared; }
+
     std::vector<neural_node *> &get_nodes() { return _nodes; }
 
+    double *values() { return _values.data(); }
+
     uint32_t node_count() { return _config._node_count; }
 
+    activation_type activation() { return _config._activation; }
+
     void enumerate(uint32_t show_nodes);
 
     ~neural_layer() { delete_nodes(); }
 
 private:
+    // Thresholds copied, weights squashed into (-1, 1), as a row-major
+    // node x input matrix.
+    std::shared_ptr<const layer_weights> build_weights() {
+        std::shared_ptr<layer_weights> w = std::make_shared<layer_weights>();
+        uint32_t size = _config._node_count * _config._input_count;
+        w->_id = _config._id;
+        w->_thresholds.assign(_config._thresholds, _config._thresholds + _config._node_count);
+        w->_weights.resize(size);
+        for (uint32_t i = 0; i < size; i++) {
+            w->_weights[i] = softsign(_config._weights[i]);
+        }
+        return w;
+    }
+
+    // One source layer's values, read through a run of _count weight columns.
+    struct input_block {
+        uint32_t        _source = 0;
+        uint32_t        _count = 0;
+        const double   *_values = nullptr;  // the source layer's values unless rebound
+    };
+
     uint32_t                    _node_count = 0;
+    uint32_t                    _input_count = 0;
     std::mt19937               &_gen;
     std::vector<neural_node *>  _nodes;
-    layer_config               &_config;
+    layer_config                _config;
+    std::vector<input_block>    _blocks;        // in column order
+    std::vector<double>         _values;        // index: node
+    std::vector<double>         _sums;          // index: node, weighted sum before activation
+    std::vector<uint32_t>       _changed;       // nodes whose value the last update changed
+    std::vector<double>         _deltas;        // index: like _changed, new value - old value
+    std::shared_ptr<const layer_weights> _shared;
+    const double               *_thresholds = nullptr;  // _shared's, for the inner loops
+    const double               *_weights = nullptr;
 };
 
 
@@ -119,25 +158,42 @@ public:
         : _gen(gen),
           _config(config) {}
 
-    void init() {
-        _layer_count = _config.get_layer_count();
-        for (uint32_t i = 0; i < _layer_count; i++) {
-            neural_layer *layer = new neural_layer(_gen, _config.get_layer_configs()[i]);
-            layer->init();
-            _layers.push_back(layer);
-        }
-        connect_layers();
+    // A clone shares other's genome and the weights of its layers until
+    // either is mutated; then only the layers the mutation touched are
+    // copied. The team setting comes along, on assignment too.
+    neural_structure(const neural_structure &other)
+        : _team(other._team),
+          _min_parallel_work(other._min_parallel_work),
+          _gen(other._gen),
+          _config(other._config) {
+        build(other._layers);
+    }
+
+    neural_structure &operator=(const neural_structure &other) {
+        _team = other._team;
+        _min_parallel_work = other._min_parallel_work;
+        _config = other._config;
+        rebuild_from(other);
+        return *this;
     }
 
+    void init() { build(std::vector<neural_layer *>()); }
+
+    // Wire every layer to its sources and group the layers into levels: a
+    // layer's level is one past the deepest of its sources, so the layers of
+    // a level only read earlier levels and can be computed together.
     void connect_layers() {
-        neural_layer *last = nullptr;
-        for (auto &l : _layers) {
-            if (!last) {
-                last = l;
-                continue;
+        std::vector<uint32_t> depth(_layer_count, 0);
+        _levels.clear();
+        for (uint32_t l = 1; l < _layer_count; l++) {
+            _layers[l]->connect_sources(_layers);
+            uint64_t sources = _config.sources(l);
+            depth[l] = 1;
+            for (uint32_t s = 0; s < l; s++) {
+                if (sources & layer_bit(s)) depth[l] = std::max(depth[l], depth[s] + 1);
             }
-            l->connect_back_layer(last);
-            last = l;
+            if (_levels.size() < depth[l]) _levels.resize(depth[l]);
+            _levels[depth[l] - 1].push_back(l);
         }
     }
         
@@ -148,10 +204,31 @@ public:
         _layers.clear();
     }
 
-    void fill_input_neurons(std::vector<double> &inputs);
+    void fill_input_neurons(const std::vector<double> &inputs);
+
+    // Have the layers fed by the input layer read count inputs in place from
+    // a buffer the caller keeps valid and unchanged through compute_network().
+    // Nothing is copied and the input layer's own values are left as they
+    // were; fill_input_neurons() switches back to them.
+    void bind_inputs(const double *inputs, uint32_t count) {
+        assert(count == _layers[0]->node_count());
+        for (uint32_t l = 1; l < _layer_count; l++) _layers[l]->set_inputs(0, inputs);
+    }
 
     void compute_network();
 
+    // bind_inputs() and compute_network() in one, for inputs that change a
+    // few at a time. Only the inputs that differ from the last call are
+    // pushed through: each adds weight * change to the sums of the nodes it
+    // feeds, and a node passes a change on only if its value changed. A
+    // threshold node that does not flip stops the change there, so with
+    // binary activations most changes die out within a layer.
+    //
+    // The first call after init() or compute_network() runs in full, and so
+    // does every _refresh_interval-th, since sums kept by adding changes
+    // drift from a full recompute by rounding. Runs serially.
+    void update_network(const double *inputs, uint32_t count);
+
     neural_layer *get_input_layer() { return _layers[0]; }
 
     neural_layer *get_output_layer() { return _layers[_layer_count - 1]; }
@@ -162,17 +239,86 @@ public:
 
     void describe() { _config.describe(); }
 
-    void mutate() {
-        if (_config.mutate()) {
-            delete_layers();
-            init();
+    void mutate(std::vector<mutation_record> *applied = nullptr) {
+        if (_config.mutate(true, applied)) {
+            rebuild();
+        }
+    }
+
+    // Rebuild the network after the config was changed in place. Layers
+    // the change left alone keep their weights.
+    void rebuild() { rebuild_from(*this); }
+
+    // Rebuild after the config was changed, taking the weights of every
+    // layer the config shares with donor's layers from donor.
+    void rebuild_from(const neural_structure &donor) {
+        std::vector<neural_layer *> old;
+        old.swap(_layers);
+        build(&donor == this ? old : donor._layers);
+        for (auto &l : old) {
+            delete l;
         }
     }
 
+    // Rebuild this structure as a mutated copy of parent.
+    void reproduce(const structure_config &parent, std::vector<mutation_record> *applied = nullptr) {
+        _config = parent;
+        _config.mutate(true, applied);
+        rebuild();
+    }
+
+    // The same, sharing every layer the mutation left alone with parent.
+    void reproduce(const neural_structure &parent, std::vector<mutation_record> *applied = nullptr) {
+        _config = parent._config;
+        _config.mutate(true, applied);
+        rebuild_from(parent);
+    }
+
+    structure_config &get_config() { return _config; }
+
+    // Split layers of at least min_work multiply-adds across team, with a
+    // barrier after each level. Networks with no layer that wide still run
+    // serially. The team is shared, not owned, and runs one network at a
+    // time.
+    void set_team(thread_team *team, uint32_t min_work = 32768) {
+        _team = team;
+        _min_parallel_work = min_work;
+    }
+
 private:
+    // Create the layers for _config, reusing the weights of any donor layer
+    // built from the same layer genes.
+    void build(const std::vector<neural_layer *> &donors) {
+        _primed = false;
+        _config.stamp_layers();
+        _layer_count = _config.get_layer_count();
+        for (uint32_t i = 0; i < _layer_count; i++) {
+            layer_config config = _config.get_layer_config(i);
+            std::shared_ptr<const layer_weights> shared;
+            for (auto d : donors) {
+                if (d->get_weights()->_id == config._id) {
+                    shared = d->get_weights();
+                    break;
+                }
+            }
+            neural_layer *layer = new neural_layer(_gen, config);
+            layer->init(shared);
+            _layers.push_back(layer);
+        }
+        connect_layers();
+    }
+
+    void compute_team(uint32_t member, uint32_t size);
+
     uint32_t                        _layer_count = 0;
+    thread_team                    *_team = nullptr;
+    uint32_t                        _min_parallel_work = 0;
+    bool                            _primed = false;    // sums match the input layer's values
+    uint32_t                        _updates = 0;       // incremental updates since the last full compute
+    const uint32_t                  _refresh_interval = 256;
     std::mt19937                   &_gen;
     std::vector<neural_layer *>     _layers;
+    std::vector<std::vector<uint32_t>> _levels;   // index: level - 1, value: its layers
     structure_config                _config;
 };
 
@@ -0,0 +1,108 @@
+#pragma once
+#include <string.h>
+#include <cmath>
+#include <cstdint>
+#include "neural_map.h"
+
+namespace nn {
+
+// Storage formats for dormant genes. The shape part of a genome (header,
+// layer sizes, activations, sources) is always kept exactly.
+//
+// Conversion rounds to nearest, ties to even, so for a gene g the stored
+// value g' satisfies |g' - g| <= u * |g| with unit roundoff
+//     FP16: u = 2^-11 ~ 4.9e-4, for 2^-14 <= |g| <= 65504
+//     BF16: u = 2^-8  ~ 3.9e-3, for 2^-126 <= |g| <= 3.4e38
+// Below the normal range the error is at most half the smallest subnormal
+// (2^-25 for FP16, 2^-134 for BF16); above it values saturate to the
+// largest finite number. Freshly drawn genes lie in [0, 1], where the error
+// is at most 2^-12 (FP16) or 2^-9 (BF16). softsign has slope at most 1, so
+// a squashed weight moves no more than its gene, and a node's weighted sum
+// over n inputs in [-1, 1] by at most n times that. Continuous activations
+// inherit the bound; a THRESHOLD node only changes its output if its
+// softsign sum was already within that distance of its threshold.
+enum gene_format {
+    GENE_FP64 = 0,
+    GENE_FP16,
+    GENE_BF16
+};
+
+// Round x to the nearest 16 bit float with the given field widths.
+template <int EXPONENT_BITS, int FRACTION_BITS>
+inline uint16_t narrow_gene(double x) {
+    const int bias = (1 << (EXPONENT_BITS - 1)) - 1;
+    const uint32_t infinity = ((1u << EXPONENT_BITS) - 1) << FRACTION_BITS;
+
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    uint16_t sign = (bits >> 48) & 0x8000;
+    uint32_t raw_exponent = (bits >> 52) & 0x7ff;
+    uint64_t mantissa = bits & ((1ull << 52) - 1);
+    if (raw_exponent == 0x7ff) return sign | infinity | (mantissa ? 1u << (FRACTION_BITS - 1) : 0);
+
+    int exponent = (int)raw_exponent - 1023;
+    int min_exponent = 1 - bias;
+    if (exponent < min_exponent - FRACTION_BITS - 1) return sign;
+    if (exponent > bias) return sign | (infinity - 1);
+
+    // Drop the low bits of the 53 bit significand, one more per step into
+    // the subnormal range.
+    uint64_t significand = mantissa | (1ull << 52);
+    int shift = 52 - FRACTION_BITS + (exponent < min_exponent ? min_exponent - exponent : 0);
+    uint64_t kept = significand >> shift;
+    uint64_t rest = significand & ((1ull << shift) - 1);
+    uint64_t half = 1ull << (shift - 1);
+    if (rest > half || (rest == half && (kept & 1))) kept++;
+
+    // A carry out of the fraction correctly bumps the exponent.
+    uint32_t result = exponent < min_exponent
+                    ? (uint32_t)kept
+                    : ((uint32_t)(exponent + bias) << FRACTION_BITS) + (uint32_t)kept - (1u << FRACTION_BITS);
+    if (result >= infinity) result = infinity - 1;
+    return sign | result;
+}
+
+template <int EXPONENT_BITS, int FRACTION_BITS>
+inline double widen_gene(uint16_t h) {
+    const int bias = (1 << (EXPONENT_BITS - 1)) - 1;
+    const uint32_t max_exponent = (1u << EXPONENT_BITS) - 1;
+    static const double subnormal_unit = std::ldexp(1.0, 1 - bias - FRACTION_BITS);
+
+    uint32_t exponent = (h >> FRACTION_BITS) & max_exponent;
+    uint64_t fraction = h & ((1u << FRACTION_BITS) - 1);
+    double sign = h & 0x8000 ? -1 : 1;
+    if (exponent == 0) return sign * (double)fraction * subnormal_unit;
+    if (exponent == max_exponent) return fraction ? NAN : sign * INFINITY;
+
+    uint64_t bits = ((uint64_t)(h & 0x8000) << 48)
+                  | ((uint64_t)(exponent - bias + 1023) << 52)
+                  | (fraction << (52 - FRACTION_BITS));
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+inline uint16_t to_fp16(double x) { return narrow_gene<5, 10>(x); }
+inline double from_fp16(uint16_t h) { return widen_gene<5, 10>(h); }
+inline uint16_t to_bf16(double x) { return narrow_gene<8, 7>(x); }
+inline double from_bf16(uint16_t h) { return widen_gene<8, 7>(h); }
+
+inline void pack_genes(gene_format format, const double *genes, uint16_t *packed, uint32_t count) {
+    if (format == GENE_BF16) {
+        for (uint32_t i = 0; i < count; i++) packed[i] = to_bf16(genes[i]);
+    }
+    else {
+        for (uint32_t i = 0; i < count; i++) packed[i] = to_fp16(genes[i]);
+    }
+}
+
+inline void unpack_genes(gene_format format, const uint16_t *packed, double *genes, uint32_t count) {
+    if (format == GENE_BF16) {
+        for (uint32_t i = 0; i < count; i++) genes[i] = from_bf16(packed[i]);
+    }
+    else {
+        for (uint32_t i = 0; i < count; i++) genes[i] = from_fp16(packed[i]);
+    }
+}
+
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace nn {
+
+enum perf_counter {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+// What a thread of neural_pool was doing while the counters ran.
+enum perf_phase {
+    PERF_EVALUATE = 0,      // computing or scoring candidates
+    PERF_MUTATE,            // structure_config::mutate
+    PERF_REBUILD,           // rebuilding networks from mutated configs
+    PERF_PHASE_COUNT
+};
+
+struct perf_sample {
+    uint64_t _counts[PERF_COUNTER_COUNT] = {};
+
+    perf_sample &operator+=(const perf_sample &other) {
+        for (uint32_t c = 0; c < PERF_COUNTER_COUNT; c++) _counts[c] += other._counts[c];
+        return *this;
+    }
+
+    perf_sample operator-(const perf_sample &other) const {
+        perf_sample d;
+        for (uint32_t c = 0; c < PERF_COUNTER_COUNT; c++) d._counts[c] = _counts[c] - other._counts[c];
+        return d;
+    }
+};
+
+// Hardware counters of the thread that opens them, read as one group so all
+// of them cover the same instructions. Counters the CPU or the kernel's
+// perf_event_paranoid setting refuse read as 0; if the kernel multiplexes
+// the group, counts are scaled up to the time it was enabled.
+class perf_group {
+
+public:
+    perf_group() {
+        for (auto &fd : _fds) fd = -1;
+    }
+
+    // Open for the calling thread on first use. False if nothing could be.
+    bool open() {
+        if (_tried) return _leader >= 0;
+        _tried = true;
+#ifdef __linux__
+        static const uint32_t types[PERF_COUNTER_COUNT] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+        };
+        static const uint64_t configs[PERF_COUNTER_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (uint32_t c = 0; c < PERF_COUNTER_COUNT; c++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[c];
+            attr.config = configs[c];
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = _leader < 0;
+            _fds[c] = syscall(__NR_perf_event_open, &attr, 0, -1, _leader, 0);
+            if (_fds[c] < 0) continue;
+            if (_leader < 0) _leader = _fds[c];
+            _slots[_opened++] = c;
+        }
+        if (_leader < 0) return false;
+        ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Running totals since open(); all zero if the group is not open.
+    void read(perf_sample &sample) {
+        sample = perf_sample();
+#ifdef __linux__
+        if (_leader < 0) return;
+        uint64_t buffer[3 + PERF_COUNTER_COUNT];
+        if (::read(_leader, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+        double scale = buffer[2] ? (double)buffer[1] / buffer[2] : 0;
+        for (uint32_t i = 0; i < buffer[0] && i < _opened; i++) {
+            sample._counts[_slots[i]] = buffer[3 + i] * scale;
+        }
+#endif
+    }
+
+    ~perf_group() {
+#ifdef __linux__
+        for (auto &fd : _fds) {
+            if (fd >= 0) ::close(fd);
+        }
+#endif
+    }
+
+private:
+    perf_group(const perf_group &) = delete;
+    perf_group &operator=(const perf_group &) = delete;
+
+    bool        _tried = false;
+    int         _leader = -1;
+    int         _fds[PERF_COUNTER_COUNT];
+    uint32_t    _slots[PERF_COUNTER_COUNT] = {};   // index: position in a group read, value: perf_counter
+    uint32_t    _opened = 0;
+};
+
+// One thread's counts for each phase.
+struct perf_phases {
+    perf_sample _phases[PERF_PHASE_COUNT];
+};
+
+// Print one row per thread and phase that ran; thread 0 is the caller,
+// thread i the pool's worker i - 1.
+inline void print_perf(uint64_t generation, const std::vector<perf_phases> &threads) {
+    static const char *names[PERF_PHASE_COUNT] = { "evaluate", "mutate", "rebuild" };
+    printf("perf generation %llu:%14s %14s %6s %12s %12s %12s\n", (unsigned long long)generation,
+           "cycles", "instructions", "IPC", "L1D miss", "LLC miss", "branch miss");
+    for (uint32_t t = 0; t < threads.size(); t++) {
+        for (uint32_t p = 0; p < PERF_PHASE_COUNT; p++) {
+            const uint64_t *c = threads[t]._phases[p]._counts;
+            if (!c[PERF_CYCLES] && !c[PERF_INSTRUCTIONS]) continue;
+            char label[32];
+            if (t) snprintf(label, sizeof(label), "worker %u %s", t - 1, names[p]);
+            else snprintf(label, sizeof(label), "caller %s", names[p]);
+            printf("  %-24s%14llu %14llu %6.2f %12llu %12llu %12llu\n", label,
+                   (unsigned long long)c[PERF_CYCLES], (unsigned long long)c[PERF_INSTRUCTIONS],
+                   c[PERF_CYCLES] ? (double)c[PERF_INSTRUCTIONS] / c[PERF_CYCLES] : 0.0,
+                   (unsigned long long)c[PERF_L1D_MISSES], (unsigned long long)c[PERF_LLC_MISSES],
+                   (unsigned long long)c[PERF_BRANCH_MISSES]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "neural_pool.h"
+
+namespace nn {
+
+// Parallel partial selection over per-candidate scores, indexed like
+// neural_pool::get_structures(). Higher scores are better and ties go to the
+// lower index, so results do not depend on how the work was split.
+//
+// Nothing here sorts the whole population: top_k keeps a k-element heap per
+// worker slice and merges the heaps at the end, and tournaments only touch
+// the entrants they draw.
+class selection {
+
+public:
+    // grain: minimum candidates per worker before another one is used.
+    selection(neural_pool &pool, uint32_t grain = 16384)
+        : _pool(pool),
+          _grain(grain) {}
+
+    // Indices of the k best scores, best first.
+    void top_k(const std::vector<double> &scores, uint32_t k, std::vector<uint32_t> &best) {
+        uint32_t count = scores.size();
+        k = std::min(k, count);
+        best.clear();
+        if (!k) return;
+
+        better_than better(scores);
+        uint32_t workers = workers_for(count);
+        std::vector<std::vector<uint32_t> > heaps(workers);
+        _pool.parallel_for(workers, count, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            // Heap ordered so the worst kept candidate is at the front.
+            std::vector<uint32_t> &heap = heaps[worker];
+            heap.reserve(k);
+            for (uint32_t i = begin; i < end; i++) {
+                if (heap.size() < k) {
+                    heap.push_back(i);
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+                else if (better(i, heap.front())) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = i;
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+            }
+        });
+
+        for (auto &heap : heaps) {
+            best.insert(best.end(), heap.begin(), heap.end());
+        }
+        std::partial_sort(best.begin(), best.begin() + k, best.end(), better);
+        best.resize(k);
+    }
+
+    // `count` tournament winners, each the best of `size` entrants drawn
+    // uniformly with replacement. Draw j of slot i comes from a counter based
+    // stream on (seed, i, j), so the winners only depend on the seed.
+    void tournament(const std::vector<double> &scores, uint32_t count, uint32_t size,
+                    uint64_t seed, std::vector<uint32_t> &winners) {
+        winners.resize(count);
+        if (scores.empty()) return;
+        uint64_t population = scores.size();
+        better_than better(scores);
+        _pool.parallel_for(workers_for((uint64_t)count * size), count, [&](uint32_t worker, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint64_t stream = splitmix64(seed ^ splitmix64(i));
+                uint32_t winner = UINT32_MAX;
+                for (uint32_t j = 0; j < size; j++) {
+                    uint64_t r = splitmix64(stream + j);
+                    uint32_t entrant = (uint32_t)(((r >> 32) * population) >> 32);
+                    if (winner == UINT32_MAX || better(entrant, winner)) winner = entrant;
+                }
+                winners[i] = winner;
+            }
+        });
+    }
+
+    // Rank 0 for the best candidate up to k - 1 for the k-th best; everyone
+    // outside the top k gets rank k.
+    void assign_ranks(const std::vector<double> &scores, uint32_t k, std::vector<uint32_t> &ranks) {
+        std::vector<uint32_t> best;
+        top_k(scores, k, best);
+        ranks.assign(scores.size(), best.size());
+        for (uint32_t r = 0; r < best.size(); r++) {
+            ranks[best[r]] = r;
+        }
+    }
+
+private:
+    struct better_than {
+        better_than(const std::vector<double> &scores) : _scores(scores) {}
+
+        bool operator()(uint32_t a, uint32_t b) const {
+            if (_scores[a] != _scores[b]) return _scores[a] > _scores[b];
+            return a < b;
+        }
+
+        const std::vector<double> &_scores;
+    };
+
+    uint32_t workers_for(uint64_t work) {
+        return std::max<uint64_t>(1, std::min<uint64_t>(_pool.max_workers(), work / _grain));
+    }
+
+    neural_pool    &_pool;
+    uint32_t        _grain = 0;
+};
+
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include "inference_server.h"
+#include "genome_store.h"
+
+// Serve evolved genomes over a Unix domain socket.
+//   nn_server.exe <socket> [genome store | model file] [latency budget us] [max batch] [team size]
+// Every record in the store becomes a model, numbered in store order. With
+// no store, four random 5-in/3-out networks are served for load testing.
+// A team size above 1 splits the wide layers of each model across threads.
+//
+// A model file is mapped and served in place, with nothing to build, so a
+// restart is ready at once. Compile one from a store with
+//   nn_server.exe --compile <genome store> <model file>
+
+static nn::inference_server *server = nullptr;
+static_assert(ATOMIC_BOOL_LOCK_FREE == 2, "request_stop() must not take a lock");
+
+// Only async-signal-safe work here: serve() notices the flag and shuts
+// down from its own thread.
+static void handle_signal(int) {
+    if (server) server->request_stop();
+}
+
+// Write every record of a genome store to a model file.
+static int compile(const char *store_path, const char *model_path) {
+    std::mt19937 gen;
+    nn::genome_store store;
+    if (!store.open(store_path)) return 1;
+    std::vector<nn::structure_config> configs(store.size(), nn::structure_config(gen));
+    for (uint64_t i = 0; i < store.size(); i++) {
+        store.load(i, configs[i]);
+    }
+    if (!nn::model_file::write(model_path, configs)) return 1;
+    printf("Compiled %u models into %s\n", (uint32_t)configs.size(), model_path);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && !strcmp(argv[1], "--compile")) {
+        return compile(argv[2], argv[3]);
+    }
+    if (argc < 2) {
+        printf("usage: %s <socket> [genome store | model file] [latency budget us] [max batch] [team size]\n"
+               "       %s --compile <genome store> <model file>\n", argv[0], argv[0]);
+        return 1;
+    }
+    uint32_t budget = argc > 3 ? atoi(argv[3]) : 200;
+    uint32_t max_batch = argc > 4 ? atoi(argv[4]) : 64;
+    uint32_t team_size = argc > 5 ? atoi(argv[5]) : 1;
+
+    std::mt19937 gen(std::random_device{}());
+    nn::thread_team team(team_size);
+    nn::inference_server s(gen, budget, max_batch);
+    s.set_team(&team);
+    nn::structure_config config(gen);
+    nn::model_file models;
+    if (argc > 2 && nn::model_file::is_model_file(argv[2])) {
+        if (!models.open(argv[2])) return 1;
+        for (uint32_t i = 0; i < models.model_count(); i++) {
+            s.add_model(models.model(i));
+        }
+    }
+    else if (argc > 2 && strcmp(argv[2], "-")) {
+        nn::genome_store store;
+        if (!store.open(argv[2])) return 1;
+        for (uint64_t i = 0; i < store.size(); i++) {
+            store.load(i, config);
+            s.add_model(config);
+        }
+    }
+    else {
+        config.set_input_neuron_count(5);
+        config.set_output_neuron_count(3);
+        for (uint32_t i = 0; i < 4; i++) {
+            config.random();
+            s.add_model(config);
+        }
+    }
+
+    server = &s;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    printf("Serving %u models on %s (budget %uus, batch %u)\n", s.model_count(), argv[1], budget, max_batch);
+    return s.serve(argv[1]) ? 0 : 1;
+}
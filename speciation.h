@@ -0,0 +1,213 @@
+#pragma once
+#include <unordered_map>
+#include "neural_structure.h"
+#include "neural_simd.h"
+
+namespace nn {
+
+struct compatibility_weights {
+    double layer    = 1.0;  // per layer of depth difference
+    double node     = 0.5;  // per node of width difference, layer by layer
+    double gene     = 2.0;  // per unit of mean threshold/weight difference
+    double skip     = 0.5;  // per source layer one has and the other lacks, layer by layer
+};
+
+// Topology part of the distance: depth difference plus the per-layer width
+// and source difference, with missing layers counting as zero nodes.
+inline double topology_distance(const structure_config &a,
+                                const structure_config &b,
+                                const compatibility_weights &c) {
+    uint32_t la = a.get_layer_count();
+    uint32_t lb = b.get_layer_count();
+    uint32_t shared = std::min(la, lb);
+    double width = 0;
+    uint32_t skips = 0;
+    for (uint32_t l = 0; l < shared; l++) {
+        width += std::abs((double)a.node_count(l) - (double)b.node_count(l));
+        for (uint64_t d = a.sources(l) ^ b.sources(l); d; d &= d - 1) skips++;
+    }
+    for (uint32_t l = shared; l < la; l++) width += a.node_count(l);
+    for (uint32_t l = shared; l < lb; l++) width += b.node_count(l);
+    return c.layer * std::abs((double)la - (double)lb) + c.node * width + c.skip * skips;
+}
+
+// Compatibility distance between two genomes. Genes are aligned by layer,
+// node and input position; the gene term is the mean absolute difference
+// over the aligned thresholds and weights. Returns as soon as the topology
+// part alone exceeds limit.
+inline double compatibility_distance(const structure_config &a,
+                                     const structure_config &b,
+                                     const compatibility_weights &c,
+                                     double limit = HUGE_VAL) {
+    double distance = topology_distance(a, b, c);
+    if (distance > limit) return distance;
+
+    uint32_t shared = std::min(a.get_layer_count(), b.get_layer_count());
+    double sum = 0;
+    uint64_t count = 0;
+    for (uint32_t l = 0; l < shared; l++) {
+        uint32_t nodes = std::min(a.node_count(l), b.node_count(l));
+        sum += simd::abs_diff_sum(a.thresholds(l), b.thresholds(l), nodes);
+        count += nodes;
+
+        uint32_t ia = a.input_count(l);
+        uint32_t ib = b.input_count(l);
+        uint32_t inputs = std::min(ia, ib);
+        for (uint32_t n = 0; n < nodes; n++) {
+            sum += simd::abs_diff_sum(a.weights(l) + n * ia, b.weights(l) + n * ib, inputs);
+        }
+        count += (uint64_t)nodes * inputs;
+    }
+    if (count) distance += c.gene * sum / count;
+    return distance;
+}
+
+// NEAT-style speciation. Each species keeps a representative genome from the
+// previous generation; a candidate joins the first species whose
+// representative is within the threshold, or founds a new one.
+//
+// Representatives are bucketed by (layer count, total nodes / bucket width).
+// The topology distance bounds how far apart two compatible genomes' keys can
+// be, so a candidate is only compared with representatives in the few
+// neighbouring buckets that could possibly match.
+class speciation {
+
+public:
+    speciation(double threshold = 3.0,
+               compatibility_weights weights = compatibility_weights(),
+               uint32_t bucket_width = 4)
+        : _threshold(threshold),
+          _weights(weights),
+          _bucket_width(bucket_width) {}
+
+    void speciate(std::vector<neural_structure *> &structures) {
+        build_buckets();
+        for (auto &s : _species) s._size = 0;
+
+        _species_of.resize(structures.size());
+        for (uint32_t i = 0; i < structures.size(); i++) {
+            structure_config &config = structures[i]->get_config();
+            uint32_t species = find_species(config);
+            if (species == UINT32_MAX) {
+                species = _species.size();
+                _species.push_back(species_entry(config));
+                _buckets[bucket_key(config, 0, 0)].push_back(species);
+            }
+            if (!_species[species]._size++) {
+                _species[species]._first_member = i;
+            }
+            _species_of[i] = species;
+        }
+        compact(structures);
+    }
+
+    // Species index of a candidate from the last speciate() call.
+    uint32_t species_of(uint32_t candidate) { return _species_of[candidate]; }
+
+    uint32_t species_count() { return _species.size(); }
+
+    uint32_t species_size(uint32_t species) { return _species[species]._size; }
+
+    // Explicit fitness sharing: a candidate's fitness divided by the size of
+    // its species, so small new species are not swamped by a large one.
+    double shared_fitness(uint32_t candidate, double fitness) {
+        return fitness / _species[_species_of[candidate]]._size;
+    }
+
+    uint64_t comparisons() { return _comparisons; }
+
+private:
+    struct species_entry {
+        species_entry(const structure_config &representative)
+            : _representative(representative) {}
+
+        structure_config    _representative;
+        uint32_t            _size = 0;
+        uint32_t            _first_member = 0;
+    };
+
+    uint64_t bucket_key(const structure_config &config, int32_t layer_offset, int32_t node_offset) {
+        uint32_t total = 0;
+        for (uint32_t l = 0; l < config.get_layer_count(); l++) {
+            total += config.node_count(l);
+        }
+        int64_t layers = (int64_t)config.get_layer_count() + layer_offset;
+        int64_t bucket = (int64_t)(total / _bucket_width) + node_offset;
+        if (layers < 0 || bucket < 0) return UINT64_MAX;
+        return ((uint64_t)layers << 32) | (uint64_t)bucket;
+    }
+
+    uint32_t find_species(const structure_config &config) {
+        // |depth difference| * layer weight and |total node difference| * node
+        // weight are both lower bounds on the distance. A zero weight bounds
+        // nothing, so that axis reaches every bucket.
+        double layer_reach = _weights.layer > 0 ? std::floor(_threshold / _weights.layer) : HUGE_VAL;
+        double node_reach = _weights.node > 0 ? std::floor(_threshold / (_weights.node * _bucket_width)) + 1 : HUGE_VAL;
+        uint32_t best = UINT32_MAX;
+        if ((2 * layer_reach + 1) * (2 * node_reach + 1) > _buckets.size()) {
+            // Fewer buckets exist than the reach covers; filter them instead.
+            uint64_t own = bucket_key(config, 0, 0);
+            for (auto &bucket : _buckets) {
+                double dl = std::abs((double)(bucket.first >> 32) - (double)(own >> 32));
+                double dn = std::abs((double)(uint32_t)bucket.first - (double)(uint32_t)own);
+                if (dl <= layer_reach && dn <= node_reach) search_bucket(config, bucket.second, best);
+            }
+            return best;
+        }
+        for (int32_t dl = -(int32_t)layer_reach; dl <= (int32_t)layer_reach; dl++) {
+            for (int32_t dn = -(int32_t)node_reach; dn <= (int32_t)node_reach; dn++) {
+                uint64_t key = bucket_key(config, dl, dn);
+                if (key == UINT64_MAX) continue;
+                auto bucket = _buckets.find(key);
+                if (bucket == _buckets.end()) continue;
+                search_bucket(config, bucket->second, best);
+            }
+        }
+        return best;
+    }
+
+    // Lower best to the first species in bucket, if any, that config is
+    // compatible with.
+    void search_bucket(const structure_config &config, const std::vector<uint32_t> &bucket, uint32_t &best) {
+        for (auto &species : bucket) {
+            if (species >= best) break;
+            _comparisons++;
+            if (compatibility_distance(config, _species[species]._representative, _weights, _threshold) <= _threshold) {
+                best = species;
+                break;
+            }
+        }
+    }
+
+    // Drop species that lost all members and make each survivor's first
+    // member of this generation its representative for the next one.
+    void compact(std::vector<neural_structure *> &structures) {
+        std::vector<uint32_t> remap(_species.size(), UINT32_MAX);
+        std::vector<species_entry> survivors;
+        for (uint32_t s = 0; s < _species.size(); s++) {
+            if (!_species[s]._size) continue;
+            remap[s] = survivors.size();
+            survivors.push_back(_species[s]);
+            survivors.back()._representative = structures[_species[s]._first_member]->get_config();
+        }
+        _species.swap(survivors);
+        for (auto &s : _species_of) s = remap[s];
+    }
+
+    void build_buckets() {
+        _buckets.clear();
+        for (uint32_t s = 0; s < _species.size(); s++) {
+            _buckets[bucket_key(_species[s]._representative, 0, 0)].push_back(s);
+        }
+    }
+
+    double                                              _threshold = 0;
+    compatibility_weights                               _weights;
+    uint32_t                                            _bucket_width = 0;
+    uint64_t                                            _comparisons = 0;
+    std::vector<species_entry>                          _species;
+    std::vector<uint32_t>                               _species_of;
+    std::unordered_map<uint64_t, std::vector<uint32_t> > _buckets;
+};
+
+}
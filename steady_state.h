@@ -0,0 +1,296 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "anytime_search.h"
+#include "lockfree_queue.h"
+
+#ifndef __linux__
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
+#endif
+
+namespace nn {
+
+// Steady-state evolution of a pool's population, with no generation
+// barrier. Every worker loops on its own: pick a parent by tournament, copy
+// and mutate it, score the child on the cases, and push the result to a
+// lock-free queue. The thread in run() pops results as they arrive and
+// replaces the population's worst member with any child scoring at least as
+// well, so a slow candidate only holds up its own worker. It finds the worst
+// member on a min-heap of scores, and sleeps while the queue stays empty.
+//
+// Workers read parents under a lock held only for the copy. Results travel
+// in per-worker slots that the selector hands back once it has used them;
+// a worker whose slots are all in flight waits for one.
+//
+// The budget is the anytime_search one. Evaluations are claimed before they
+// start, so max_evaluations is never exceeded. Runs are not reproducible:
+// which parents a worker sees depends on timing. When run() returns the
+// pool holds the final population.
+class steady_state_search {
+
+public:
+    // workers 0: the pool's max_workers().
+    steady_state_search(neural_pool &pool,
+                        const std::vector<test_case> &cases,
+                        const fitness_function &fitness,
+                        uint32_t workers = 0,
+                        uint32_t tournament_size = 2)
+        : _pool(pool),
+          _cases(cases),
+          _fitness(fitness),
+          _worker_count(workers ? workers : pool.max_workers()),
+          _tournament_size(std::max(1u, tournament_size)),
+          _results(_worker_count * _slots_per_worker),
+          _best(_gen) {}
+
+    // Returns the best score found, -infinity if nothing was evaluated.
+    double run(const search_budget &budget = search_budget()) {
+        std::vector<neural_structure *> &structures = _pool.get_structures();
+        _pool.evaluate_pool(_cases, _fitness, _scores);
+        _population.assign(structures.size(), structure_config(_gen));
+        for (uint32_t i = 0; i < structures.size(); i++) {
+            _population[i] = structures[i]->get_config();
+            offer(_population[i], _scores[i]);
+        }
+        _evaluations += structures.size();
+        _claimed = _evaluations.load();
+        _worst.resize(_population.size());
+        for (uint32_t i = 0; i < _worst.size(); i++) _worst[i] = i;
+        std::make_heap(_worst.begin(), _worst.end(), better_than(_scores));
+        _max_evaluations = budget._max_evaluations;
+
+        std::vector<worker_state *> workers;
+        std::vector<std::thread> threads;
+        for (uint32_t i = 0; i < _worker_count && !_population.empty(); i++) {
+            workers.push_back(new worker_state(splitmix64(_seed ^ splitmix64(i))));
+            threads.push_back(std::thread(&steady_state_search::worker_thread, this, workers.back()));
+        }
+        while (!threads.empty()) {
+            result *r = nullptr;
+            bool popped = next_result(r, threads.size(), budget._deadline);
+            if (popped) consume(r);
+            bool done = _stop || best_score() >= budget._target ||
+                        std::chrono::steady_clock::now() >= budget._deadline ||
+                        (!popped && _idle == threads.size());
+            if (done) break;
+        }
+        _stop = true;
+        for (auto &t : threads) t.join();
+        result *r = nullptr;
+        while (_results.pop(r)) consume(r);
+        for (auto w : workers) delete w;
+
+        for (uint32_t i = 0; i < _population.size(); i++) {
+            structures[i]->get_config() = _population[i];
+            structures[i]->rebuild();
+        }
+        _stop = false;
+        _idle = 0;
+        return best_score();
+    }
+
+    // Ask a running search to return soon. Asked while no search runs, the
+    // next run() returns after scoring the population.
+    void stop() {
+        _stop = true;
+        wake_selector();
+    }
+
+    // Copy out the best genome so far; false if there is none yet.
+    bool best(structure_config &config, double &score) {
+        std::lock_guard<std::mutex> lock(_best_lock);
+        if (_best_score == -std::numeric_limits<double>::infinity()) return false;
+        config = _best;
+        score = _best_score;
+        return true;
+    }
+
+    double best_score() {
+        std::lock_guard<std::mutex> lock(_best_lock);
+        return _best_score;
+    }
+
+    uint64_t evaluations() { return _evaluations; }
+
+    // Children that took a place in the population.
+    uint64_t replacements() { return _replacements; }
+
+    // Seeds the workers' generators.
+    void set_seed(uint64_t seed) { _seed = seed; }
+
+private:
+    steady_state_search(const steady_state_search &) = delete;
+    steady_state_search &operator=(const steady_state_search &) = delete;
+
+    struct worker_state;
+
+    struct result {
+        result(std::mt19937 &gen) : _config(gen) {}
+
+        structure_config        _config;
+        double                  _score = 0;
+        std::atomic<bool>       _in_flight{false};
+    };
+
+    struct worker_state {
+        worker_state(uint64_t seed)
+            : _gen((std::mt19937::result_type)seed),
+              _network(_gen, structure_config(_gen)) {
+            for (uint32_t i = 0; i < _slots_per_worker; i++) _slots.push_back(new result(_gen));
+        }
+
+        ~worker_state() {
+            for (auto r : _slots) delete r;
+        }
+
+        std::mt19937            _gen;
+        neural_structure        _network;
+        std::vector<result *>   _slots;
+    };
+
+    void worker_thread(worker_state *w) {
+        uint32_t next = 0;
+        while (!_stop) {
+            result *r = w->_slots[next];
+            if (r->_in_flight.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+                continue;
+            }
+            if (_claimed.fetch_add(1) >= _max_evaluations) {
+                _idle++;
+                wake_selector();
+                return;
+            }
+            next = (next + 1) % w->_slots.size();
+
+            pick_parent(w->_gen, r->_config);
+            r->_config.mutate();
+            w->_network.get_config() = r->_config;
+            w->_network.rebuild();
+            r->_score = evaluate_structure(&w->_network, _cases, _fitness);
+            r->_in_flight.store(true, std::memory_order_release);
+            bool pushed = _results.push(r);
+            assert(pushed);
+            (void)pushed;
+            // Pairs with the fence in next_result(): either the selector
+            // sees this result, or this worker sees it waiting.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_selector_waiting.load(std::memory_order_relaxed)) wake_selector();
+        }
+    }
+
+    // Pop a result, spinning briefly and then sleeping until one arrives,
+    // every worker is out of evaluations, stop() is called or the deadline
+    // passes. Returns false if nothing was popped.
+    bool next_result(result *&r, uint32_t workers, std::chrono::steady_clock::time_point deadline) {
+        for (uint32_t i = 0; i < _spin_count; i++) {
+            if (_results.pop(r)) return true;
+        }
+        std::unique_lock<std::mutex> lock(_wake_lock);
+        _selector_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool popped = false;
+        // The wait is bounded so a passing deadline is noticed.
+        std::chrono::steady_clock::time_point until =
+            std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+        _wake_cv.wait_until(lock, until, [&] {
+            popped = _results.pop(r);
+            return popped || _stop || _idle == workers;
+        });
+        _selector_waiting.store(false, std::memory_order_relaxed);
+        return popped;
+    }
+
+    void wake_selector() {
+        { std::lock_guard<std::mutex> lock(_wake_lock); }
+        _wake_cv.notify_one();
+    }
+
+    // Tournament among random members, copied into child.
+    void pick_parent(std::mt19937 &gen, structure_config &child) {
+        std::lock_guard<std::mutex> lock(_population_lock);
+        std::uniform_int_distribution<uint32_t> member(0, _population.size() - 1);
+        uint32_t winner = member(gen);
+        for (uint32_t i = 1; i < _tournament_size; i++) {
+            uint32_t entrant = member(gen);
+            if (_scores[entrant] > _scores[winner]) winner = entrant;
+        }
+        child = _population[winner];
+    }
+
+    void consume(result *r) {
+        _evaluations++;
+        offer(r->_config, r->_score);
+        uint32_t worst = _worst.front();
+        if (r->_score >= _scores[worst]) {
+            // Only the heap's top changes, so it can be taken off, updated
+            // and put back.
+            std::pop_heap(_worst.begin(), _worst.end(), better_than(_scores));
+            {
+                std::lock_guard<std::mutex> lock(_population_lock);
+                _population[worst] = r->_config;
+                _scores[worst] = r->_score;
+            }
+            std::push_heap(_worst.begin(), _worst.end(), better_than(_scores));
+            _replacements++;
+        }
+        r->_in_flight.store(false, std::memory_order_release);
+    }
+
+    // As a heap order, puts the lowest score at the front.
+    struct better_than {
+        better_than(const std::vector<double> &scores) : _scores(scores) {}
+
+        bool operator()(uint32_t a, uint32_t b) const { return _scores[a] > _scores[b]; }
+
+        const std::vector<double> &_scores;
+    };
+
+    void offer(const structure_config &config, double score) {
+        std::lock_guard<std::mutex> lock(_best_lock);
+        if (score <= _best_score) return;
+        _best = config;
+        _best_score = score;
+    }
+
+    static const uint32_t               _slots_per_worker = 4;
+    static const uint32_t               _spin_count = 256;  // empty pops before the selector sleeps
+
+    neural_pool                        &_pool;
+    const std::vector<test_case>       &_cases;
+    const fitness_function             &_fitness;
+    const uint32_t                      _worker_count;
+    const uint32_t                      _tournament_size;
+    uint64_t                            _seed = 0;
+    std::mt19937                        _gen;
+    lockfree_queue<result *>            _results;
+    std::atomic<bool>                   _stop{false};
+    std::atomic<uint32_t>               _idle{0};           // workers out of evaluations
+    std::atomic<uint64_t>               _claimed{0};        // evaluations started or done
+    uint64_t                            _max_evaluations = UINT64_MAX;
+    std::atomic<uint64_t>               _evaluations{0};
+    std::atomic<uint64_t>               _replacements{0};
+
+    std::mutex                          _population_lock;   // workers read, selector writes
+    std::vector<structure_config>       _population;
+    std::vector<double>                 _scores;            // index: like _population
+    std::vector<uint32_t>               _worst;             // _population indices, heap by better_than; selector only
+
+    std::mutex                          _wake_lock;
+    std::condition_variable             _wake_cv;
+    std::atomic<bool>                   _selector_waiting{false};
+
+    std::mutex                          _best_lock;
+    structure_config                    _best;
+    double                              _best_score = -std::numeric_limits<double>::infinity();
+};
+
+}
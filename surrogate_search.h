@@ -0,0 +1,328 @@
+#pragma once
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include "anytime_search.h"
+
+namespace nn {
+
+// Predicts an offspring's score from cheap facts about it: its parent's
+// score, how often each mutation operator ran to make it, and how its
+// layer and node counts moved. A ridge regression over a window of the
+// most recent offspring that were scored exactly.
+class fitness_surrogate {
+
+public:
+    static const uint32_t FEATURE_COUNT = 4 + MUTATE_OP_COUNT;
+
+    fitness_surrogate(uint32_t window = 4096, double ridge = 1e-3)
+        : _window(window),
+          _ridge(ridge),
+          _weights(FEATURE_COUNT, 0) {}
+
+    // FEATURE_COUNT values describing child, made from parent by applied.
+    static void features(const structure_config &parent, double parent_score,
+                         const structure_config &child,
+                         const std::vector<mutation_record> &applied,
+                         double *f) {
+        std::fill(f, f + FEATURE_COUNT, 0);
+        f[0] = 1;
+        f[1] = parent_score;
+        f[2] = (double)child.get_layer_count() - parent.get_layer_count();
+        f[3] = (double)node_total(child) - node_total(parent);
+        for (auto &r : applied) f[4 + r._op]++;
+    }
+
+    double predict(const double *f) const {
+        double p = 0;
+        for (uint32_t i = 0; i < FEATURE_COUNT; i++) p += _weights[i] * f[i];
+        return p;
+    }
+
+    // Record the exact score of offspring with features f, dropping the
+    // oldest sample once the window is full.
+    void add_sample(const double *f, double score) {
+        if (_samples.size() < (size_t)_window * (FEATURE_COUNT + 1)) {
+            _samples.insert(_samples.end(), f, f + FEATURE_COUNT);
+            _samples.push_back(score);
+            return;
+        }
+        double *slot = &_samples[(size_t)_next * (FEATURE_COUNT + 1)];
+        std::copy(f, f + FEATURE_COUNT, slot);
+        slot[FEATURE_COUNT] = score;
+        _next = (_next + 1) % _window;
+    }
+
+    uint32_t sample_count() const { return _samples.size() / (FEATURE_COUNT + 1); }
+
+    // Fit to the window. Until there are two samples per feature, or if they
+    // leave the fit singular, the previous fit stays and false is returned.
+    bool refit() {
+        uint32_t n = sample_count();
+        if (n < 2 * FEATURE_COUNT) return false;
+        const uint32_t d = FEATURE_COUNT;
+        std::vector<double> a(d * d, 0), b(d, 0);
+        for (uint32_t s = 0; s < n; s++) {
+            const double *x = &_samples[(size_t)s * (d + 1)];
+            for (uint32_t i = 0; i < d; i++) {
+                for (uint32_t j = 0; j < d; j++) a[i * d + j] += x[i] * x[j];
+                b[i] += x[i] * x[d];
+            }
+        }
+        // The constant term is not shrunk.
+        for (uint32_t i = 1; i < d; i++) a[i * d + i] += _ridge * n;
+        if (!solve(a, b, d)) return false;
+        _weights = b;
+        _fitted = true;
+        return true;
+    }
+
+    bool fitted() const { return _fitted; }
+
+private:
+    static uint32_t node_total(const structure_config &config) {
+        uint32_t nodes = 0;
+        for (uint32_t l = 0; l < config.get_layer_count(); l++) nodes += config.node_count(l);
+        return nodes;
+    }
+
+    // Gaussian elimination with partial pivoting; the solution replaces b.
+    static bool solve(std::vector<double> &a, std::vector<double> &b, uint32_t d) {
+        for (uint32_t c = 0; c < d; c++) {
+            uint32_t pivot = c;
+            for (uint32_t r = c + 1; r < d; r++) {
+                if (fabs(a[r * d + c]) > fabs(a[pivot * d + c])) pivot = r;
+            }
+            if (fabs(a[pivot * d + c]) < 1e-12) return false;
+            if (pivot != c) {
+                for (uint32_t j = 0; j < d; j++) std::swap(a[c * d + j], a[pivot * d + j]);
+                std::swap(b[c], b[pivot]);
+            }
+            for (uint32_t r = c + 1; r < d; r++) {
+                double factor = a[r * d + c] / a[c * d + c];
+                for (uint32_t j = c; j < d; j++) a[r * d + j] -= factor * a[c * d + j];
+                b[r] -= factor * b[c];
+            }
+        }
+        for (uint32_t c = d; c-- > 0;) {
+            for (uint32_t j = c + 1; j < d; j++) b[c] -= a[c * d + j] * b[j];
+            b[c] /= a[c * d + c];
+        }
+        return true;
+    }
+
+    const uint32_t          _window;
+    const double            _ridge;
+    std::vector<double>     _samples;   // per sample: FEATURE_COUNT features, then the score
+    uint32_t                _next = 0;  // oldest sample, once the window is full
+    std::vector<double>     _weights;   // index: feature
+    bool                    _fitted = false;
+};
+
+// Generational search that only scores the offspring worth scoring. Each
+// generation every member makes one child and a fitness_surrogate predicts
+// each child's score. The evaluate_fraction of the children predicted to
+// score best are scored exactly, along with about
+// explore_fraction of the rest picked at random, so the surrogate keeps
+// seeing the kind of child it rejects. A scored child replaces its parent
+// if it scores at least as well; the others are dropped unscored. The
+// surrogate is refit on the new exact scores after every generation, and
+// until it has enough of them every child is scored.
+//
+// A child whose only mutations changed the mutation chart has its parent's
+// genes and so its score; it takes the parent's place without an
+// evaluation. Children are built sharing their parent's unchanged layers
+// and scored on the pool's workers.
+//
+// Budgets are those of anytime_search: a generation starts only if the last
+// one's duration fits before the deadline, and the evaluations a
+// generation makes are capped to what is left.
+class surrogate_search {
+
+public:
+    surrogate_search(neural_pool &pool,
+                     const std::vector<test_case> &cases,
+                     const fitness_function &fitness,
+                     double evaluate_fraction = .25,
+                     double explore_fraction = .05)
+        : _pool(pool),
+          _cases(cases),
+          _fitness(fitness),
+          _evaluate_fraction(evaluate_fraction),
+          _explore_fraction(explore_fraction),
+          _best(_gen) {}
+
+    // Returns the best score found, -infinity if nothing was evaluated.
+    double run(const search_budget &budget = search_budget()) {
+        std::vector<neural_structure *> &structures = _pool.get_structures();
+        uint32_t size = structures.size();
+        if (budget._max_evaluations - _evaluations < size) return best_score();
+        _pool.evaluate_pool(_cases, _fitness, _scores);
+        _evaluations += size;
+        for (uint32_t i = 0; i < size; i++) offer(structures[i]->get_config(), _scores[i]);
+        while (_children.size() < size) _children.push_back(structure_config(_gen));
+        while (_offspring.size() < size) _offspring.push_back(new neural_structure(_gen, structure_config(_gen)));
+        _features.resize(size * fitness_surrogate::FEATURE_COUNT);
+        _predicted.resize(size);
+
+        std::chrono::steady_clock::duration last_generation(0);
+        while (!_stop && best_score() < budget._target) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (budget._max_evaluations == _evaluations) break;
+            if (budget._deadline - start < last_generation) break;
+            generation(budget._max_evaluations - _evaluations);
+            _generations++;
+            last_generation = std::chrono::steady_clock::now() - start;
+        }
+        _stop = false;
+        return best_score();
+    }
+
+    // Ask a running search to return after its current generation.
+    void stop() { _stop = true; }
+
+    // Copy out the best genome so far; false if there is none yet.
+    bool best(structure_config &config, double &score) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (_best_score == -std::numeric_limits<double>::infinity()) return false;
+        config = _best;
+        score = _best_score;
+        return true;
+    }
+
+    double best_score() {
+        std::lock_guard<std::mutex> lock(_lock);
+        return _best_score;
+    }
+
+    uint64_t evaluations() { return _evaluations; }
+
+    uint64_t generations() { return _generations; }
+
+    // Children dropped on the surrogate's word, without an evaluation.
+    uint64_t screened() { return _screened; }
+
+    // Children that took their parent's place.
+    uint64_t replacements() { return _replacements; }
+
+    // Mean absolute error of the surrogate's predictions for the children
+    // scored in the last generation, before it was refit on them; 0 until
+    // it has been fit.
+    double prediction_error() { return _prediction_error; }
+
+    const fitness_surrogate &get_surrogate() { return _surrogate; }
+
+    // Seeds the mutations and the exploration picks.
+    void set_seed(uint64_t seed) { _gen.seed((std::mt19937::result_type)(seed ^ (seed >> 32))); }
+
+    ~surrogate_search() {
+        for (auto s : _offspring) delete s;
+    }
+
+private:
+    surrogate_search(const surrogate_search &) = delete;
+    surrogate_search &operator=(const surrogate_search &) = delete;
+
+    void generation(uint64_t remaining) {
+        const uint32_t f = fitness_surrogate::FEATURE_COUNT;
+        std::vector<neural_structure *> &structures = _pool.get_structures();
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < structures.size(); i++) {
+            structure_config &parent = structures[i]->get_config();
+            structure_config &child = _children[i];
+            child = parent;
+            _applied.clear();
+            child.mutate(true, &_applied);
+            bool changed = false;
+            for (auto &r : _applied) changed |= r._op != MUTATE_STRENGTH;
+            if (!changed) {
+                parent = child;
+                continue;
+            }
+            fitness_surrogate::features(parent, _scores[i], child, _applied, &_features[i * f]);
+            _predicted[i] = _surrogate.predict(&_features[i * f]);
+            candidates.push_back(i);
+        }
+
+        // Best prediction first; ties stay in index order.
+        uint32_t keep = candidates.size();
+        if (_surrogate.fitted()) {
+            keep = std::min(keep, (uint32_t)ceil(_evaluate_fraction * candidates.size()));
+            std::stable_sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+                return _predicted[a] > _predicted[b];
+            });
+        }
+        std::vector<uint32_t> chosen(candidates.begin(), candidates.begin() + keep);
+        std::uniform_real_distribution<> coin(0, 1);
+        for (uint32_t c = keep; c < candidates.size(); c++) {
+            if (coin(_gen) < _explore_fraction) chosen.push_back(candidates[c]);
+        }
+        if (chosen.size() > remaining) chosen.resize(remaining);
+        _screened += candidates.size() - chosen.size();
+
+        for (uint32_t j = 0; j < chosen.size(); j++) {
+            _offspring[j]->get_config() = _children[chosen[j]];
+            _offspring[j]->rebuild_from(*structures[chosen[j]]);
+        }
+        std::vector<double> scores(chosen.size());
+        _pool.parallel_for(_pool.max_workers(), chosen.size(), [&](uint32_t, uint32_t begin, uint32_t end) {
+            for (uint32_t j = begin; j < end; j++) {
+                scores[j] = evaluate_structure(_offspring[j], _cases, _fitness);
+            }
+        });
+        _evaluations += chosen.size();
+
+        double error = 0;
+        for (uint32_t j = 0; j < chosen.size(); j++) {
+            uint32_t i = chosen[j];
+            error += fabs(_predicted[i] - scores[j]);
+            _surrogate.add_sample(&_features[i * f], scores[j]);
+            offer(_children[i], scores[j]);
+            if (scores[j] < _scores[i]) continue;
+            structures[i]->get_config() = _children[i];
+            structures[i]->rebuild_from(*_offspring[j]);
+            _scores[i] = scores[j];
+            _replacements++;
+        }
+        if (_surrogate.fitted() && !chosen.empty()) _prediction_error = error / chosen.size();
+        _surrogate.refit();
+    }
+
+    void offer(const structure_config &config, double score) {
+        std::lock_guard<std::mutex> lock(_lock);
+        if (score <= _best_score) return;
+        _best = config;
+        _best_score = score;
+    }
+
+    neural_pool                        &_pool;
+    const std::vector<test_case>       &_cases;
+    const fitness_function             &_fitness;
+    const double                        _evaluate_fraction;
+    const double                        _explore_fraction;
+    std::mt19937                        _gen;
+    fitness_surrogate                   _surrogate;
+    std::atomic<bool>                   _stop{false};
+    std::atomic<uint64_t>               _evaluations{0};
+    std::atomic<uint64_t>               _generations{0};
+    std::atomic<uint64_t>               _screened{0};
+    std::atomic<uint64_t>               _replacements{0};
+    std::atomic<double>                 _prediction_error{0};
+
+    std::vector<double>                 _scores;        // index: pool candidate, exact
+    std::vector<structure_config>       _children;      // index: like _scores
+    std::vector<double>                 _features;      // index: candidate * FEATURE_COUNT + feature
+    std::vector<double>                 _predicted;     // index: like _scores
+    std::vector<mutation_record>        _applied;
+    std::vector<neural_structure *>     _offspring;     // index: position in a generation's chosen children
+
+    std::mutex                          _lock;
+    structure_config                    _best;
+    double                              _best_score = -std::numeric_limits<double>::infinity();
+};
+
+}
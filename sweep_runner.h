@@ -0,0 +1,187 @@
+#pragma once
+#include <stdio.h>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <vector>
+#include "neural_pool.h"
+#include "work_stealing.h"
+
+namespace nn {
+
+// One configuration of a sweep.
+struct experiment {
+    std::string     _name;
+    uint32_t        _pool_size = 10;
+    uint32_t        _max_layer_count = 7;
+    uint32_t        _max_node_count = 10;
+    mutation_chart  _chart;
+    uint64_t        _seed = 1;
+    uint64_t        _max_generations = 1000;
+    double          _target = std::numeric_limits<double>::infinity();  // stop once a candidate scores this
+    double          _share = 1;     // claim on the executor, relative to the other experiments
+};
+
+struct experiment_result {
+    uint64_t        _generations = 0;
+    uint64_t        _evaluations = 0;
+    double          _best_score = -std::numeric_limits<double>::infinity();
+    uint64_t        _best_generation = 0;
+    uint32_t        _best_layers = 0;
+    uint32_t        _best_nodes = 0;
+    double          _seconds = 0;   // spent running its generations
+};
+
+// Runs many independent experiments in one process on one shared
+// work_stealing_executor. An experiment advances a generation per task:
+// score its pool on the cases, keep the best score, mutate. Its pool stays
+// single threaded, so the executor's threads are the only ones working.
+//
+// Scheduling is fair share. Whenever a thread frees up, the waiting
+// experiment that has had the least run time for its share goes next, and
+// an experiment never has more than one generation in flight. Pools are
+// seeded, so results do not depend on the scheduling.
+class sweep_runner {
+
+public:
+    sweep_runner(work_stealing_executor &executor,
+                 const std::vector<test_case> &cases,
+                 const fitness_function &fitness)
+        : _executor(executor),
+          _cases(cases),
+          _fitness(fitness) {}
+
+    // Only between runs.
+    void add(const experiment &e) { _runs.push_back(new run_state(e)); }
+
+    // Run every experiment added so far to its end.
+    void run() {
+        std::unique_lock<std::mutex> lock(_lock);
+        _remaining = 0;
+        for (auto r : _runs) _remaining += !r->_done;
+        for (uint32_t i = 0; i < _executor.size(); i++) schedule();
+        _done_cv.wait(lock, [this] { return _remaining == 0; });
+    }
+
+    uint32_t size() { return _runs.size(); }
+
+    const experiment &get_experiment(uint32_t i) { return _runs[i]->_experiment; }
+
+    const experiment_result &result(uint32_t i) { return _runs[i]->_result; }
+
+    // One tab separated row per experiment, after a header row.
+    void write_results(FILE *f) {
+        fprintf(f, "name\tpool\tmax_layers\tmax_nodes\tshare\tgenerations\tevaluations\t"
+                   "best\tbest_generation\tbest_layers\tbest_nodes\tseconds\n");
+        for (auto r : _runs) {
+            const experiment &e = r->_experiment;
+            const experiment_result &x = r->_result;
+            fprintf(f, "%s\t%u\t%u\t%u\t%g\t%llu\t%llu\t%g\t%llu\t%u\t%u\t%.3f\n",
+                    e._name.c_str(), e._pool_size, e._max_layer_count, e._max_node_count, e._share,
+                    (unsigned long long)x._generations, (unsigned long long)x._evaluations,
+                    x._best_score, (unsigned long long)x._best_generation,
+                    x._best_layers, x._best_nodes, x._seconds);
+        }
+    }
+
+    bool write_results(const char *path) {
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            printf("sweep_runner: cannot create %s\n", path);
+            return false;
+        }
+        write_results(f);
+        return fclose(f) == 0;
+    }
+
+    ~sweep_runner() {
+        for (auto r : _runs) {
+            delete r->_pool;
+            delete r;
+        }
+    }
+
+private:
+    sweep_runner(const sweep_runner &) = delete;
+    sweep_runner &operator=(const sweep_runner &) = delete;
+
+    struct run_state {
+        run_state(const experiment &e) : _experiment(e) {}
+
+        experiment              _experiment;
+        experiment_result       _result;
+        neural_pool            *_pool = nullptr;    // from its first generation until its last
+        std::vector<double>     _scores;
+        double                  _virtual_time = 0;  // seconds run / share
+        bool                    _running = false;
+        bool                    _done = false;
+    };
+
+    // One generation of r, on an executor thread.
+    void step(run_state *r) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const experiment &e = r->_experiment;
+        experiment_result &x = r->_result;
+        if (!r->_pool) {
+            r->_pool = new neural_pool(e._pool_size);
+            r->_pool->set_max_workers(1);
+            r->_pool->set_seed(e._seed);
+            r->_pool->set_genome_limits(e._max_layer_count, e._max_node_count);
+            r->_pool->set_mutation_chart(e._chart);
+            r->_pool->init();
+        }
+
+        r->_pool->evaluate_pool(_cases, _fitness, r->_scores);
+        x._evaluations += r->_scores.size();
+        for (uint32_t i = 0; i < r->_scores.size(); i++) {
+            if (r->_scores[i] <= x._best_score) continue;
+            const structure_config &best = r->_pool->get_structures()[i]->get_config();
+            x._best_score = r->_scores[i];
+            x._best_generation = x._generations;
+            x._best_layers = best.get_layer_count();
+            x._best_nodes = 0;
+            for (uint32_t l = 0; l < best.get_layer_count(); l++) x._best_nodes += best.node_count(l);
+        }
+        x._generations++;
+        bool done = x._generations >= e._max_generations || x._best_score >= e._target;
+        if (done) {
+            delete r->_pool;
+            r->_pool = nullptr;
+        }
+        else {
+            r->_pool->mutate_pool();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(_lock);
+        x._seconds += seconds;
+        r->_virtual_time += seconds / e._share;
+        r->_running = false;
+        r->_done = done;
+        schedule();
+        if (done && --_remaining == 0) _done_cv.notify_all();
+    }
+
+    // With _lock held: hand the waiting experiment that is furthest behind
+    // its share to the executor, if there is one.
+    void schedule() {
+        run_state *next = nullptr;
+        for (auto r : _runs) {
+            if (r->_running || r->_done) continue;
+            if (!next || r->_virtual_time < next->_virtual_time) next = r;
+        }
+        if (!next) return;
+        next->_running = true;
+        _executor.submit([this, next] { step(next); });
+    }
+
+    work_stealing_executor             &_executor;
+    const std::vector<test_case>       &_cases;
+    const fitness_function             &_fitness;
+    std::vector<run_state *>            _runs;
+    std::mutex                          _lock;
+    std::condition_variable             _done_cv;
+    uint32_t                            _remaining = 0;     // experiments not done
+};
+
+}
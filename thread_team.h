@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef __linux__
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
+#endif
+
+namespace nn {
+
+// A fixed team of threads that run one job together, for splitting a single
+// network's layers across cores.
+//
+// neural_pool hands out large, independent slices and sleeps in between;
+// here the work between synchronizations is one layer, a few microseconds,
+// so members spin on atomics instead. Idle members spin briefly for the
+// next job and then block, so an idle team costs nothing.
+class thread_team {
+
+public:
+    // size counts the caller, which runs as member 0.
+    thread_team(uint32_t size = std::max(1u, std::thread::hardware_concurrency()))
+        : _size(std::max(1u, size)) {
+        for (uint32_t i = 1; i < _size; i++) {
+            _threads.push_back(std::thread(&thread_team::member_thread, this, i));
+        }
+    }
+
+    uint32_t size() { return _size; }
+
+    // Run job(member, size) on every member and return once all finished.
+    // Only one job runs at a time.
+    void run(const std::function<void(uint32_t, uint32_t)> &job) {
+        if (_size == 1) {
+            job(0, 1);
+            return;
+        }
+        _job = &job;
+        _remaining.store(_size - 1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _generation.fetch_add(1, std::memory_order_release);
+        }
+        _start_cv.notify_all();
+        job(0, _size);
+        for (uint32_t spins = 0; _remaining.load(std::memory_order_acquire); spins++) {
+            pause(spins);
+        }
+        _job = nullptr;
+    }
+
+    // Wait inside a job until every member reaches the same barrier.
+    void barrier() {
+        uint32_t phase = _phase.load(std::memory_order_acquire);
+        if (_arrived.fetch_add(1, std::memory_order_acq_rel) == _size - 1) {
+            _arrived.store(0, std::memory_order_relaxed);
+            _phase.store(phase + 1, std::memory_order_release);
+            return;
+        }
+        for (uint32_t spins = 0; _phase.load(std::memory_order_acquire) == phase; spins++) {
+            pause(spins);
+        }
+    }
+
+    ~thread_team() {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stopping = true;
+            _generation.fetch_add(1, std::memory_order_release);
+        }
+        _start_cv.notify_all();
+        for (auto &t : _threads) t.join();
+    }
+
+private:
+    thread_team(const thread_team &) = delete;
+    thread_team &operator=(const thread_team &) = delete;
+
+    // Spin with a CPU hint, and give the core away if a wait drags on.
+    static void pause(uint32_t spins) {
+        if (spins < 1024) {
+#ifdef __SSE2__
+            _mm_pause();
+#endif
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+    void member_thread(uint32_t member) {
+        uint64_t seen = 0;
+        while (true) {
+            uint64_t generation = _generation.load(std::memory_order_acquire);
+            for (uint32_t spins = 0; generation == seen && spins < _spin_limit; spins++) {
+                pause(spins);
+                generation = _generation.load(std::memory_order_acquire);
+            }
+            if (generation == seen) {
+                std::unique_lock<std::mutex> lock(_lock);
+                _start_cv.wait(lock, [&] { return _generation.load(std::memory_order_relaxed) != seen; });
+                generation = _generation.load(std::memory_order_relaxed);
+            }
+            seen = generation;
+            if (_stopping) return;
+            (*_job)(member, _size);
+            _remaining.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    const uint32_t                                  _size;
+    const uint32_t                                  _spin_limit = 1 << 14;
+    const std::function<void(uint32_t, uint32_t)>  *_job = nullptr;
+    std::atomic<uint64_t>                           _generation{0};
+    std::atomic<uint32_t>                           _remaining{0};
+    std::atomic<uint32_t>                           _arrived{0};
+    std::atomic<uint32_t>                           _phase{0};
+    bool                                            _stopping = false;
+    std::mutex                                      _lock;
+    std::condition_variable                         _start_cv;
+    std::vector<std::thread>                        _threads;
+};
+
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#ifndef __linux__
+#include "mingw.thread.h"
+#include "mingw.mutex.h"
+#include "mingw.condition_variable.h"
+#endif
+
+namespace nn {
+
+// A fixed set of threads running independent tasks, meant to be the one
+// executor of a process so that several users of it never oversubscribe
+// the machine.
+//
+// Every thread has its own deque. A task submitted from one of the threads
+// goes on that thread's deque, which it works newest first, so a task's
+// continuation tends to run where its data is still in cache. A thread with
+// nothing left steals the oldest task of another. Tasks submitted from
+// outside are dealt out round robin.
+class work_stealing_executor {
+
+public:
+    work_stealing_executor(uint32_t size = std::max(1u, std::thread::hardware_concurrency()))
+        : _queues(std::max(1u, size)) {
+        for (uint32_t i = 0; i < _queues.size(); i++) {
+            _threads.push_back(std::thread(&work_stealing_executor::worker_thread, this, i));
+        }
+    }
+
+    uint32_t size() { return _queues.size(); }
+
+    void submit(std::function<void()> task) {
+        uint32_t i = 0;
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _queued++;
+            _unfinished++;
+            i = current().first == this ? current().second : _next++ % _queues.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(_queues[i]._lock);
+            _queues[i]._tasks.push_back(std::move(task));
+        }
+        _work_cv.notify_one();
+    }
+
+    // Wait until every submitted task, including those submitted by tasks,
+    // has run.
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(_lock);
+        _idle_cv.wait(lock, [this] { return _unfinished == 0; });
+    }
+
+    // Tasks still queued when the executor goes are run first.
+    ~work_stealing_executor() {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stopping = true;
+        }
+        _work_cv.notify_all();
+        for (auto &t : _threads) t.join();
+    }
+
+private:
+    work_stealing_executor(const work_stealing_executor &) = delete;
+    work_stealing_executor &operator=(const work_stealing_executor &) = delete;
+
+    struct queue {
+        std::mutex                          _lock;
+        std::deque<std::function<void()> >  _tasks;
+    };
+
+    // Executor and index of the calling thread, if it is a worker.
+    static std::pair<work_stealing_executor *, uint32_t> &current() {
+        static thread_local std::pair<work_stealing_executor *, uint32_t> slot(nullptr, 0);
+        return slot;
+    }
+
+    void worker_thread(uint32_t i) {
+        current() = std::make_pair(this, i);
+        std::function<void()> task;
+        while (true) {
+            if (!take(i, task)) {
+                std::unique_lock<std::mutex> lock(_lock);
+                _work_cv.wait(lock, [this] { return _stopping || _queued > 0; });
+                if (_stopping && _queued == 0) return;
+                continue;
+            }
+            task();
+            task = nullptr;
+            std::lock_guard<std::mutex> lock(_lock);
+            if (--_unfinished == 0) _idle_cv.notify_all();
+        }
+    }
+
+    // The newest task of thread i's own deque, or else the oldest of the
+    // first other deque that has one.
+    bool take(uint32_t i, std::function<void()> &task) {
+        for (uint32_t k = 0; k < _queues.size(); k++) {
+            queue &q = _queues[(i + k) % _queues.size()];
+            {
+                std::lock_guard<std::mutex> lock(q._lock);
+                if (q._tasks.empty()) continue;
+                if (k == 0) {
+                    task = std::move(q._tasks.back());
+                    q._tasks.pop_back();
+                }
+                else {
+                    task = std::move(q._tasks.front());
+                    q._tasks.pop_front();
+                }
+            }
+            std::lock_guard<std::mutex> lock(_lock);
+            _queued--;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<queue>                  _queues;    // index: thread
+    std::vector<std::thread>            _threads;
+    std::mutex                          _lock;
+    std::condition_variable             _work_cv;
+    std::condition_variable             _idle_cv;
+    uint32_t                            _queued = 0;        // tasks in deques, counted before they land
+    uint32_t                            _unfinished = 0;    // submitted and not yet run to completion
+    uint32_t                            _next = 0;          // deque for the next outside submission
+    bool                                _stopping = false;
+};
+
+}